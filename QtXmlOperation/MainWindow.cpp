@@ -4,13 +4,22 @@
 #include <QUrl>
 #include <QFileInfo>
 #include <QHeaderView>
+#include <QElapsedTimer>
+#include <QVBoxLayout>
+#include <QtConcurrentRun>
 #include <QDebug>
+#include "QtXmlSimd.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
     m_xml(NULL),
-    m_treeWidget(new QTreeWidget(this))
+    m_treeWidget(new QTreeWidget(this)),
+    m_searchEdit(new QLineEdit(this)),
+    m_searchTimer(new QTimer(this)),
+    m_indexWatcher(new QFutureWatcher<QtXmlSearchIndex>(this)),
+    m_searchWatcher(new QFutureWatcher<QVector<int> >(this)),
+    m_searchStale(false)
 {
     ui->setupUi(this);
 
@@ -22,6 +31,10 @@ MainWindow::MainWindow(QWidget *parent) :
 
     // XML unit test
     //xmlTest();
+    //xmlParserTest();
+
+    // XML read benchmark
+    //xmlBenchmark("./1.xml");
 
     // Set Window Title
     this->setWindowTitle(tr("XML Viewer"));
@@ -32,6 +45,10 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    // Do not leave the index and search threads writing into destroyed watchers
+    m_indexWatcher->waitForFinished();
+    m_searchWatcher->waitForFinished();
+
     delete ui;
 
     if(NULL != m_xml)
@@ -90,7 +107,26 @@ void MainWindow::initWidgetStyle()
     headers << "Items" << "Attributes" << "Text";
     m_treeWidget->setHeaderLabels(headers);
 
-    setCentralWidget(m_treeWidget);
+    // Search box above the tree
+    QWidget *centralWidget = new QWidget(this);
+    QVBoxLayout *layout = new QVBoxLayout(centralWidget);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(2);
+    layout->addWidget(m_searchEdit);
+    layout->addWidget(m_treeWidget);
+
+    setCentralWidget(centralWidget);
+
+    m_searchEdit->setPlaceholderText(tr("Search tags, attributes and texts"));
+
+    // Filter once typing pauses
+    m_searchTimer->setSingleShot(true);
+    m_searchTimer->setInterval(150);
+
+    connect(m_searchEdit, SIGNAL(textChanged(QString)), this, SLOT(onSearchTextChanged(QString)));
+    connect(m_searchTimer, SIGNAL(timeout()), this, SLOT(onSearchTimeout()));
+    connect(m_indexWatcher, SIGNAL(finished()), this, SLOT(onIndexFinished()));
+    connect(m_searchWatcher, SIGNAL(finished()), this, SLOT(onSearchFinished()));
 
     // Enable drag&drop for
     m_treeWidget->installEventFilter(this);
@@ -160,7 +196,140 @@ void MainWindow::xmlTest()
 
 }
 
-void MainWindow::parseDomToItem(const QDomElement &element, QTreeWidgetItem *parent)
+void MainWindow::xmlParserTest()
+{
+    QList<QByteArray> samples;
+
+    // Well-formed, both parsers must build the same tree
+    samples << QByteArray("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<a x=\"1\" y='2'><b>text</b><c/><d k = \"v\" /></a>")
+            << QByteArray("<a t=\"&lt;&amp;&gt;&quot;&apos;\">&lt;x&gt; &amp; &quot;&apos;</a>")
+            << QByteArray("<a v=\"&#65;&#x42;&#10;\">&#x20AC;&#8364;&#x1F600;</a>")
+            << QByteArray("<a v=\"1\r\n2\r3\t4\n5\">line1\r\nline2\rline3\n</a>")
+            << QByteArray("<a><![CDATA[<b>&amp;]]]]><![CDATA[>\r\nx]]></a>")
+            << QByteArray("<?pi data?><!-- c --><a><?target some data?><!--x--><?empty?></a><!-- after -->")
+            << QByteArray("\xEF\xBB\xBF<?xml version=\"1.0\"?><a>\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80</a>")
+            << QByteArray("<!DOCTYPE a [<!ENTITY e \"ent\">]><a>&e;</a>")
+            << QByteArray("<a>\n  <b> x </b>\n  text\n  <c>\n  </c>\n</a>\n")
+            << QByteArray("<a>") + QByteArray(50, 'x') + QByteArray("\xC3\xA9\xE2\x82\xAC", 5).repeated(10) + QByteArray("</a>")
+            << QByteArray("<\xC3\xA9l\xC3\xA9" "ment a=\"1\"/>")
+            << QByteArray("<a><b x=\"&gt;\">]]&gt;</b></a>")
+            << QByteArray("<?xml version='1.0'  encoding='utf-8' standalone=\"yes\" ?><a/>");
+
+    // Not well-formed, both parsers must fail
+    samples << QByteArray("<a x=\"1\" x=\"2\"/>")
+            << QByteArray("<a x=\"<\"/>")
+            << QByteArray("<1a/>")
+            << QByteArray("<a b=\"1\"c=\"2\"/>")
+            << QByteArray("<a><!-- a -- b --></a>")
+            << QByteArray("<a>]]></a>")
+            << QByteArray("<a><b></a></b>")
+            << QByteArray("<a/><b/>")
+            << QByteArray("<a>&unknown;</a>")
+            << QByteArray("<a></a><?xml version=\"1.0\"?>")
+            << QByteArray("<?xml foo?><a/>")
+            << QByteArray("<?xml version=\"9\"?><a/>")
+            << QByteArray("<?xml encoding=\"UTF-8\" version=\"1.0\"?><a/>");
+
+    // Small chunk sizes split every token across chunk boundaries
+    QList<int> chunkSizes;
+    chunkSizes << 0 << 1 << 2 << 3 << 5 << 8 << 13;
+
+    QString fileName = "./parser_test.xml";
+    int failures = 0;
+
+    for(int i = 0; i < samples.size(); i++)
+    {
+        QFile file(fileName);
+
+        if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qDebug() << QString("%1 can not be written!").arg(fileName);
+            return;
+        }
+
+        file.write(samples.at(i));
+        file.close();
+
+        QtXmlOperation xml;
+        xml.setParserType(QtXmlOperation::ParserQDom);
+
+        bool expectOk = xml.openDocument(fileName);
+        QString expect = expectOk ? xml.getRootElement().ownerDocument().toString() : QString();
+
+        xml.setParserType(QtXmlOperation::ParserFast);
+
+        for(int j = 0; j < chunkSizes.size(); j++)
+        {
+            xml.setReadChunkSize(chunkSizes.at(j));
+
+            bool ok = xml.openDocument(fileName);
+            QString actual = ok ? xml.getRootElement().ownerDocument().toString() : QString();
+
+            if(ok != expectOk || actual != expect)
+            {
+                qDebug() << "xmlParserTest: sample" << i << "chunk size" << chunkSizes.at(j) << "differs";
+                qDebug() << "  ParserQDom:" << expectOk << expect;
+                qDebug() << "  ParserFast:" << ok << actual;
+                failures++;
+            }
+        }
+    }
+
+    QFile::remove(fileName);
+
+    qDebug() << "xmlParserTest:" << samples.size() << "samples," << failures << "failures";
+}
+
+void MainWindow::xmlBenchmark(QString fileName)
+{
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << QString("%1 can not be opened!").arg(fileName);
+        return;
+    }
+
+    QByteArray content = file.readAll();
+    file.close();
+
+    double megaBytes = content.size() / (1024.0 * 1024.0);
+    QElapsedTimer timer;
+
+    // Baseline, parse from memory so disk speed is not measured
+    QDomDocument doc;
+    timer.start();
+    doc.setContent(content, false);
+    qint64 elapsed = qMax(timer.elapsed(), (qint64)1);
+    qDebug() << "setContent:" << elapsed << "ms," << megaBytes * 1000.0 / elapsed << "MB/s";
+    doc.clear();
+
+    QtXmlOperation xml;
+    xml.setParserType(QtXmlOperation::ParserQDom);
+    timer.start();
+    xml.openDocument(fileName);
+    elapsed = qMax(timer.elapsed(), (qint64)1);
+    qDebug() << "openDocument ParserQDom:" << elapsed << "ms," << megaBytes * 1000.0 / elapsed << "MB/s";
+
+    // Fast parser with each SIMD level the CPU supports
+    QtXmlSimd::Level best = QtXmlSimd::level();
+    xml.setParserType(QtXmlOperation::ParserFast);
+
+    for(int level = QtXmlSimd::LevelScalar; level <= best; level++)
+    {
+        QtXmlSimd::setLevel((QtXmlSimd::Level)level);
+
+        timer.start();
+        xml.openDocument(fileName);
+        elapsed = qMax(timer.elapsed(), (qint64)1);
+        qDebug() << "openDocument ParserFast" << QtXmlSimd::levelName() << ":" << elapsed << "ms,"
+                 << megaBytes * 1000.0 / elapsed << "MB/s";
+    }
+
+    QtXmlSimd::setLevel(best);
+}
+
+void MainWindow::parseDomToItem(const QDomElement &element, QTreeWidgetItem *parent, int parentIndex)
 {
     if(element.isNull())
     {
@@ -169,10 +338,15 @@ void MainWindow::parseDomToItem(const QDomElement &element, QTreeWidgetItem *par
 
     QTreeWidgetItem *item = createItem(element, parent);
 
+    // Items are created in document order, the same numbering as the search index
+    int index = m_items.size();
+    m_items.append(item);
+    m_itemParents.append(parentIndex);
+
     QDomNodeList children = element.childNodes();
     for(int i = 0; i < children.size(); i++)
     {
-        parseDomToItem(children.at(i).toElement(), item);
+        parseDomToItem(children.at(i).toElement(), item, index);
     }
 
 }
@@ -219,6 +393,11 @@ bool MainWindow::convertXMLToQTreeWidget(QString file)
     bool ret = false;
 
     // Clear tree widget
+    m_items.clear();
+    m_itemParents.clear();
+    m_itemHidden.clear();
+    m_searchIndex = QtXmlSearchIndex();
+    m_searchStale = true;
     m_treeWidget->clear();
 
     // Check opened file suffix .xml
@@ -245,7 +424,153 @@ bool MainWindow::convertXMLToQTreeWidget(QString file)
     // Auto resize the width
     m_treeWidget->header()->setResizeMode(QHeaderView::ResizeToContents);
 
+    m_itemHidden.fill(false, m_items.size());
+
+    // Build the search index in background, the tree is usable meanwhile
+    statusBar()->showMessage(tr("Indexing %1 elements...").arg(m_items.size()));
+    m_indexWatcher->setFuture(QtConcurrent::run(&QtXmlSearchIndex::build, file));
+
     ret= true;
 
     return ret;
 }
+
+void MainWindow::onSearchTextChanged(QString text)
+{
+    Q_UNUSED(text);
+
+    m_searchTimer->start();
+}
+
+void MainWindow::onSearchTimeout()
+{
+    applySearchFilter();
+}
+
+void MainWindow::onIndexFinished()
+{
+    QtXmlSearchIndex index = m_indexWatcher->result();
+
+    if(!index.errorString().isEmpty())
+    {
+        statusBar()->showMessage(tr("Indexing failed: %1").arg(index.errorString()));
+        return;
+    }
+
+    // The file may have changed between building the tree and indexing it
+    if(index.elementCount() != m_items.size())
+    {
+        statusBar()->showMessage(tr("Search index does not match the tree, drop the file again"));
+        return;
+    }
+
+    m_searchIndex = index;
+    statusBar()->showMessage(tr("Indexed %1 elements").arg(m_items.size()));
+
+    if(!m_searchEdit->text().trimmed().isEmpty())
+    {
+        applySearchFilter();
+    }
+}
+
+void MainWindow::applySearchFilter()
+{
+    QString query = m_searchEdit->text().trimmed();
+
+    if(m_searchWatcher->isRunning())
+    {
+        // Drop the running result, onSearchFinished starts again with the current text
+        m_searchStale = true;
+        return;
+    }
+
+    if(m_items.isEmpty())
+    {
+        return;
+    }
+
+    if(query.isEmpty())
+    {
+        showMatches(query, QVector<int>());
+        return;
+    }
+
+    if(0 == m_searchIndex.elementCount())
+    {
+        statusBar()->showMessage(tr("Indexing, search starts when done"));
+        return;
+    }
+
+    // Short prefixes match most of a large document, keep the UI responsive
+    m_searchQuery = query;
+    m_searchStale = false;
+    statusBar()->showMessage(tr("Searching..."));
+    m_searchWatcher->setFuture(QtConcurrent::run(m_searchIndex, &QtXmlSearchIndex::find, query));
+}
+
+void MainWindow::onSearchFinished()
+{
+    QVector<int> matches = m_searchWatcher->result();
+
+    if(m_searchStale || m_searchQuery != m_searchEdit->text().trimmed())
+    {
+        applySearchFilter();
+        return;
+    }
+
+    showMatches(m_searchQuery, matches);
+}
+
+void MainWindow::showMatches(QString query, QVector<int> matches)
+{
+    QVector<bool> visible(m_items.size(), query.isEmpty());
+
+    if(!query.isEmpty())
+    {
+        // Matches and their ancestors stay visible, stop at an ancestor already marked
+        for(int i = 0; i < matches.size(); i++)
+        {
+            int element = matches.at(i);
+
+            while(element >= 0 && !visible.at(element))
+            {
+                visible[element] = true;
+                element = m_itemParents.at(element);
+            }
+        }
+
+        statusBar()->showMessage(tr("%1 matches").arg(matches.size()));
+    }
+    else
+    {
+        statusBar()->clearMessage();
+    }
+
+    // Only touch items whose parent is shown, a hidden parent hides its whole
+    // subtree, so a filter costs one pass over ints plus the changed items
+    m_treeWidget->setUpdatesEnabled(false);
+
+    for(int i = 0; i < m_items.size(); i++)
+    {
+        int parentIndex = m_itemParents.at(i);
+
+        if(parentIndex < 0 || visible.at(parentIndex))
+        {
+            bool hidden = !visible.at(i);
+
+            if(m_itemHidden.at(i) != hidden)
+            {
+                m_items.at(i)->setHidden(hidden);
+                m_itemHidden[i] = hidden;
+            }
+        }
+    }
+
+    m_treeWidget->setUpdatesEnabled(true);
+
+    if(!matches.isEmpty())
+    {
+        m_treeWidget->setCurrentItem(m_items.at(matches.first()));
+        m_treeWidget->scrollToItem(m_items.at(matches.first()));
+    }
+}
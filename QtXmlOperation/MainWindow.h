@@ -3,7 +3,12 @@
 
 #include <QMainWindow>
 #include <QTreeWidget>
+#include <QLineEdit>
+#include <QTimer>
+#include <QVector>
+#include <QFutureWatcher>
 #include "QtXmlOperation.h"
+#include "QtXmlSearchIndex.h"
 
 namespace Ui {
 class MainWindow;
@@ -20,6 +25,12 @@ public:
 protected:
     bool eventFilter(QObject *obj, QEvent *e);
 
+private slots:
+    void onSearchTextChanged(QString text);
+    void onSearchTimeout();
+    void onIndexFinished();
+    void onSearchFinished();
+
 private:
     Ui::MainWindow *ui;
 
@@ -27,18 +38,42 @@ private:
 
     QTreeWidget *m_treeWidget;
 
+    // Search, elements are numbered in document order like QtXmlSearchIndex
+    QLineEdit *m_searchEdit;
+    QTimer *m_searchTimer;                          // Debounce typing
+    QFutureWatcher<QtXmlSearchIndex> *m_indexWatcher;
+    QFutureWatcher<QVector<int> > *m_searchWatcher;  // Runs QtXmlSearchIndex::find
+    QString m_searchQuery;                          // Query of the running find
+    bool m_searchStale;                             // Tree or query changed while find ran
+    QtXmlSearchIndex m_searchIndex;
+    QVector<QTreeWidgetItem *> m_items;             // Tree item per element
+    QVector<int> m_itemParents;                     // Parent element per element, -1 for the root
+    QVector<bool> m_itemHidden;                     // Hidden flag set on the item
+
     void xmlTest();
 
+    // Check ParserFast builds the same tree as ParserQDom, or fails the same
+    void xmlParserTest();
+
+    // Compare read throughput of QDomDocument::setContent and the fast parser
+    void xmlBenchmark(QString fileName);
+
     void initWidgetFont();  // Init the Font type and size of the widget
     void initWidgetStyle(); // Init Icon of the widget
 
     // Parse xml file to QTreeWidgetItem
-    void parseDomToItem(const QDomElement &element, QTreeWidgetItem *parent);
+    void parseDomToItem(const QDomElement &element, QTreeWidgetItem *parent, int parentIndex = -1);
     QTreeWidgetItem* createItem(const QDomElement &element, QTreeWidgetItem *parent);
 
     // Parse XML to QTreeWidget
     bool convertXMLToQTreeWidget(QString file);
 
+    // Start searching the text in background, a running search is redone when it finishes
+    void applySearchFilter();
+
+    // Show only the matched items and their ancestors, all items for an empty query
+    void showMatches(QString query, QVector<int> matches);
+
 };
 
 #endif // MAINWINDOW_H
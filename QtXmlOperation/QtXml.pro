@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Library, command line tool and viewer, build this one
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += core tool gui
+
+# All projects share one folder, give each its own Makefile
+core.file = QtXmlCore.pro
+core.makefile = Makefile.QtXmlCore
+
+tool.file = QtXmlTool.pro
+tool.makefile = Makefile.QtXmlTool
+tool.depends = core
+
+gui.file = QtXmlOperation.pro
+gui.makefile = Makefile.QtXmlOperation
+gui.depends = core
@@ -0,0 +1,8 @@
+# Link the QtXmlCore library, include from application .pro files
+QT += xml
+
+INCLUDEPATH += $$PWD
+LIBS += -L$$OUT_PWD/lib -lQtXmlCore
+
+win32-msvc*: PRE_TARGETDEPS += $$OUT_PWD/lib/QtXmlCore.lib
+else: PRE_TARGETDEPS += $$OUT_PWD/lib/libQtXmlCore.a
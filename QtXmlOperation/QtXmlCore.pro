@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# QtXmlOperation library without GUI dependency,
+# linked by the viewer and the command line tool
+#
+#-------------------------------------------------
+
+QT       -= gui
+QT       += xml
+
+TARGET = QtXmlCore
+TEMPLATE = lib
+CONFIG += staticlib
+
+# Fixed location, independent of debug_and_release sub folders
+DESTDIR = $$OUT_PWD/lib
+
+
+SOURCES += QtXmlOperation.cpp \
+    QtXmlScanner.cpp \
+    QtXmlDocumentCache.cpp \
+    QtXmlSimd.cpp \
+    QtXmlSearchIndex.cpp
+
+HEADERS += QtXmlOperation.h \
+    QtXmlScanner.h \
+    QtXmlDocumentCache.h \
+    QtXmlSimd.h \
+    QtXmlSearchIndex.h
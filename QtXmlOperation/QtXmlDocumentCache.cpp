@@ -0,0 +1,292 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           QtXmlDocumentCache.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Process wide cache of parsed xml documents
+**********************************************************************/
+
+#include "QtXmlDocumentCache.h"
+#include "QtXmlOperation.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+#include <QDebug>
+
+Q_GLOBAL_STATIC(QtXmlDocumentCache, globalDocumentCache)
+
+QtXmlDocumentCache::QtXmlDocumentCache() :
+    m_budget(256 * 1024 * 1024),
+    m_usage(0),
+    m_hashCheck(false),
+    m_tick(0)
+{
+    m_entries.clear();
+}
+
+QtXmlDocumentCache::~QtXmlDocumentCache()
+{
+}
+
+QtXmlDocumentCache *QtXmlDocumentCache::instance()
+{
+    return globalDocumentCache();
+}
+
+QDomDocument QtXmlDocumentCache::document(QString fileName, bool *ok, qint64 *cost)
+{
+    QDomDocument ret;
+    QFileInfo info(fileName);
+    QString key = info.absoluteFilePath();
+
+    if(NULL != ok)
+    {
+        *ok = false;
+    }
+
+    if(!info.exists())
+    {
+        return ret;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    for(;;)
+    {
+        // Another thread is parsing the same file, wait for it instead of parsing twice
+        while(m_loading.contains(key))
+        {
+            m_loaded.wait(&m_mutex);
+        }
+
+        if(!m_entries.contains(key))
+        {
+            break;
+        }
+
+        Entry entry = m_entries.value(key);
+        bool valid = (entry.fileSize == info.size() && entry.fileModified == info.lastModified());
+
+        if(valid && m_hashCheck)
+        {
+            // Hash outside the lock, then start over if the entry changed meanwhile
+            locker.unlock();
+            QByteArray hash = hashFile(key);
+            locker.relock();
+
+            if(m_loading.contains(key) || !m_entries.contains(key) || m_entries.value(key).doc != entry.doc)
+            {
+                continue;
+            }
+
+            valid = (entry.fileHash == hash);
+        }
+
+        Entry &current = m_entries[key];
+
+        if(valid)
+        {
+            current.lastUsed = ++m_tick;
+
+            if(NULL != ok)
+            {
+                *ok = true;
+            }
+
+            if(NULL != cost)
+            {
+                *cost = current.cost;
+            }
+
+            return current.doc;
+        }
+
+        m_usage -= current.cost;
+        m_entries.remove(key);
+        break;
+    }
+
+    // Parse outside the lock, other files stay accessible meanwhile
+    m_loading.insert(key);
+    bool hashCheck = m_hashCheck;
+    locker.unlock();
+
+    Entry entry;
+    entry.fileSize = info.size();
+    entry.fileModified = info.lastModified();
+    entry.cost = 0;
+    entry.lastUsed = 0;
+
+    bool parsed = false;
+    QFile file(key);
+
+    if(file.open(QIODevice::ReadOnly))
+    {
+        QByteArray content = file.readAll();
+        file.close();
+
+        if(hashCheck)
+        {
+            entry.fileHash = QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+        }
+
+        QString errorStr = "";
+        int errorLine = 0;
+        int errorColumn = 0;
+
+        if(entry.doc.setContent(content, false, &errorStr, &errorLine, &errorColumn))
+        {
+            entry.cost = QtXmlOperation::measureDocument(entry.doc).totalBytes;
+            parsed = true;
+        }
+        else
+        {
+            qDebug() << "Error: Parse error at line " << errorLine << ", "
+                     << "column " << errorColumn << ": "
+                     << qPrintable(errorStr);
+        }
+    }
+
+    locker.relock();
+    m_loading.remove(key);
+    m_loaded.wakeAll();
+
+    if(parsed)
+    {
+        ret = entry.doc;
+
+        // A document larger than the whole budget is handed out but not kept
+        if(entry.cost <= m_budget)
+        {
+            entry.lastUsed = ++m_tick;
+            m_entries.insert(key, entry);
+            m_usage += entry.cost;
+            evict(key);
+        }
+
+        if(NULL != ok)
+        {
+            *ok = true;
+        }
+
+        if(NULL != cost)
+        {
+            *cost = entry.cost;
+        }
+    }
+
+    return ret;
+}
+
+void QtXmlDocumentCache::remove(QString fileName)
+{
+    QMutexLocker locker(&m_mutex);
+    QString key = QFileInfo(fileName).absoluteFilePath();
+
+    if(m_entries.contains(key))
+    {
+        m_usage -= m_entries.value(key).cost;
+        m_entries.remove(key);
+    }
+}
+
+void QtXmlDocumentCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_entries.clear();
+    m_usage = 0;
+}
+
+void QtXmlDocumentCache::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_budget = bytes;
+    evict("");
+}
+
+qint64 QtXmlDocumentCache::memoryBudget()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_budget;
+}
+
+qint64 QtXmlDocumentCache::memoryUsage()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_usage;
+}
+
+void QtXmlDocumentCache::setHashCheck(bool enable)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_hashCheck = enable;
+
+    if(enable)
+    {
+        // Entries loaded without hash can not be checked, drop them
+        QHash<QString, Entry>::iterator it = m_entries.begin();
+        while(it != m_entries.end())
+        {
+            if(it.value().fileHash.isEmpty())
+            {
+                m_usage -= it.value().cost;
+                it = m_entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
+
+void QtXmlDocumentCache::evict(QString keep)
+{
+    while(m_usage > m_budget && !m_entries.isEmpty())
+    {
+        QHash<QString, Entry>::iterator oldest = m_entries.end();
+
+        QHash<QString, Entry>::iterator it;
+        for(it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            if(it.key() != keep && (oldest == m_entries.end() || it.value().lastUsed < oldest.value().lastUsed))
+            {
+                oldest = it;
+            }
+        }
+
+        if(oldest == m_entries.end())
+        {
+            break;
+        }
+
+        m_usage -= oldest.value().cost;
+        m_entries.erase(oldest);
+    }
+}
+
+QByteArray QtXmlDocumentCache::hashFile(QString fileName)
+{
+    QByteArray ret;
+    QFile file(fileName);
+
+    if(file.open(QIODevice::ReadOnly))
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+
+        while(!file.atEnd())
+        {
+            hash.addData(file.read(1024 * 1024));
+        }
+
+        ret = hash.result();
+    }
+
+    return ret;
+}
@@ -0,0 +1,147 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           QtXmlDocumentCache.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Process wide cache of parsed xml documents, entries are
+                validated by file size, modification time and optional
+                content hash, least recently used ones are evicted when
+                the memory budget is exceeded
+**********************************************************************/
+#ifndef QTXMLDOCUMENTCACHE_H
+#define QTXMLDOCUMENTCACHE_H
+
+#include <QDomDocument>
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QDateTime>
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+
+
+class QtXmlDocumentCache
+{
+public:
+
+    QtXmlDocumentCache();
+    virtual ~QtXmlDocumentCache();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		instance
+    PURPOSE:		Get the process wide cache
+    ARGUMENTS:		None
+    RETURNS:		QtXmlDocumentCache *
+    -----------------------------------------------------------------------*/
+    static QtXmlDocumentCache *instance();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		document
+    PURPOSE:		Get the parsed document of fileName, parses it on a miss or when
+                    the file changed. The returned handle shares the cached tree,
+                    it must only be read. Always parsed by QDomDocument::setContent
+                    without memory limit, the tree is shared by all callers.
+    ARGUMENTS:		QString fileName, file name
+                    bool *ok, true: successful, false: file missing or parse failed
+                    qint64 *cost, estimated bytes of the returned tree, may be NULL
+    RETURNS:		QDomDocument, shared document, null document on failure
+    -----------------------------------------------------------------------*/
+    QDomDocument document(QString fileName, bool *ok = NULL, qint64 *cost = NULL);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		remove
+    PURPOSE:		Drop the entry of fileName, handed out documents stay valid
+    ARGUMENTS:		QString fileName, file name
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void remove(QString fileName);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		clear
+    PURPOSE:		Drop all entries, handed out documents stay valid
+    ARGUMENTS:		None
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void clear();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setMemoryBudget
+    PURPOSE:		Set the memory budget, evicts entries if needed
+    ARGUMENTS:		qint64 bytes, budget in bytes
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setMemoryBudget(qint64 bytes);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		memoryBudget
+    PURPOSE:		Get the memory budget
+    ARGUMENTS:		None
+    RETURNS:		qint64, budget in bytes
+    -----------------------------------------------------------------------*/
+    qint64 memoryBudget();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		memoryUsage
+    PURPOSE:		Get the estimated memory held by cached documents
+    ARGUMENTS:		None
+    RETURNS:		qint64, bytes
+    -----------------------------------------------------------------------*/
+    qint64 memoryUsage();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setHashCheck
+    PURPOSE:		Also compare content hash when size and modification time match,
+                    the file is hashed without holding the cache lock
+    ARGUMENTS:		bool enable, true: check hash, false: size and time only
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setHashCheck(bool enable);
+
+private:
+    struct Entry
+    {
+        QDomDocument doc;
+        qint64 fileSize;
+        QDateTime fileModified;
+        QByteArray fileHash;
+        qint64 cost;        // Estimated bytes held by doc
+        quint64 lastUsed;   // LRU tick
+    };
+
+    QMutex m_mutex;
+    QWaitCondition m_loaded;
+    QHash<QString, Entry> m_entries;
+    QSet<QString> m_loading;    // Files being parsed by some thread
+
+    qint64 m_budget;
+    qint64 m_usage;
+    bool m_hashCheck;
+    quint64 m_tick;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		evict
+    PURPOSE:		Evict least recently used entries until usage fits the budget
+    ARGUMENTS:		QString keep, key not to evict, may be empty
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void evict(QString keep);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		hashFile
+    PURPOSE:		Get content hash of a file
+    ARGUMENTS:		QString fileName, file name
+    RETURNS:		QByteArray, empty on failure
+    -----------------------------------------------------------------------*/
+    static QByteArray hashFile(QString fileName);
+};
+
+#endif // QTXMLDOCUMENTCACHE_H
@@ -12,478 +12,4190 @@ PURPOSE:        Provide XML read/write operation
 #include <QStringList>
 #include <QDir>
 #include <QDebug>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QCryptographicHash>
+#include <QtConcurrentRun>
+#include <QThread>
+#include <QXmlStreamReader>
+#include <QBuffer>
+#include <QDataStream>
+#include <QtAlgorithms>
+#include <QPair>
+#include <QSet>
+#include "QtXmlScanner.h"
+#include "QtXmlSimd.h"
+#include "QtXmlDocumentCache.h"
 
 //#define ENABLE_DEBUG_TRACE_XML 1
 
-QtXmlOperation::QtXmlOperation() :
-    m_doc(new QDomDocument),
-    m_file(NULL)
+// Header of the element index file "fileName.idx"
+#define XML_INDEX_MAGIC     0x51584958
+#define XML_INDEX_VERSION   2
+
+// Estimated heap bytes per DOM object including allocator overhead
+#define XML_DOM_NODE_BYTES      112     // QDomNodePrivate
+#define XML_DOM_ELEMENT_BYTES   176     // QDomElementPrivate plus its attribute map
+#define XML_DOM_ATTR_BYTES      144     // QDomAttrPrivate plus its attribute map entry
+#define XML_STRING_BYTES        32      // QString data header
+#define XML_INDEX_ENTRY_BYTES   64      // QHash node plus QVector header of an index path
+
+static qint64 estimateString(int length)
 {
-    m_doc->clear();
+    return (length > 0) ? (XML_STRING_BYTES + 2 * (qint64)length) : 0;
 }
 
-QtXmlOperation::QtXmlOperation(QString fileName) :
-    m_doc(new QDomDocument),
-    m_file(NULL)
+// Append code point as UTF-8, false for code points not allowed in XML
+static bool appendUtf8(QByteArray *out, uint code)
 {
-    m_doc->clear();
+    if(0 == code || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+    {
+        return false;
+    }
 
-    if(!fileName.isEmpty())
+    if(code < 0x80)
     {
-        // Open file
-        // If not exist, create a new file
-        if(!openDocument(fileName))
-        {
-            createDocument();
-            saveAs(fileName);
-        }
+        out->append((char)code);
+    }
+    else if(code < 0x800)
+    {
+        out->append((char)(0xC0 | (code >> 6)));
+        out->append((char)(0x80 | (code & 0x3F)));
+    }
+    else if(code < 0x10000)
+    {
+        out->append((char)(0xE0 | (code >> 12)));
+        out->append((char)(0x80 | ((code >> 6) & 0x3F)));
+        out->append((char)(0x80 | (code & 0x3F)));
+    }
+    else
+    {
+        out->append((char)(0xF0 | (code >> 18)));
+        out->append((char)(0x80 | ((code >> 12) & 0x3F)));
+        out->append((char)(0x80 | ((code >> 6) & 0x3F)));
+        out->append((char)(0x80 | (code & 0x3F)));
     }
+
+    return true;
 }
 
-QtXmlOperation::~QtXmlOperation()
+// Check an element, attribute or processing instruction target name.
+// Returns 1 for a valid ASCII name, 0 for an invalid name and -1 for a name
+// with non-ASCII characters, whose rules are left to QDomDocument.
+static int checkXmlName(const char *data, int size)
 {
-    if(NULL != m_file)
+    if(size <= 0)
     {
-        if(m_file->isOpen())
+        return 0;
+    }
+
+    for(int i = 0; i < size; i++)
+    {
+        uchar c = (uchar)data[i];
+
+        if(c >= 0x80)
         {
-            m_file->close();
+            return -1;
+        }
+
+        bool start = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || '_' == c || ':' == c;
+
+        if(!start && (0 == i || !((c >= '0' && c <= '9') || '-' == c || '.' == c)))
+        {
+            return 0;
         }
-        delete m_file;
     }
 
-    delete m_doc;
+    return 1;
 }
 
-bool QtXmlOperation::createDocument(QString rootName)
+// Parse the pseudo attributes of the XML declaration, data follows "<?xml " without "?>".
+// value is rebuilt the way QDomDocument::setContent stores the declaration:
+// "version='1.0' encoding='UTF-8' standalone='yes'", encoding and standalone if given.
+static bool parseXmlDeclaration(const char *data, int size, QString *value)
 {
-    bool ret = false;
+    static const char *names[] = {"version", "encoding", "standalone"};
+    QByteArray values[3];
+    bool found[3] = {false, false, false};
+    int next = 0;               // Pseudo attributes must come in this order
+    int i = 0;
 
-    m_doc->clear();
-    QDomProcessingInstruction introduction = m_doc->createProcessingInstruction("xml", "version=\'1.0\' encoding=\'UTF-8\'");
-    m_doc->appendChild(introduction);
+    for(;;)
+    {
+        int ws = QtXmlSimd::skipWhitespace(data + i, size - i);
 
-    // Create root element
-    createRoot(rootName);
+        if(i + ws >= size)
+        {
+            break;
+        }
 
-    ret = true;
+        if(i > 0 && 0 == ws)
+        {
+            return false;
+        }
 
-    return ret;
-}
+        i += ws;
 
-bool QtXmlOperation::createRoot(QString rootName)
-{
-    bool ret = false;
+        int nameLen = QtXmlSimd::findFirstOf(data + i, size - i, "= \t\r\n");
 
-    // If root is not empty, append root element
-    if(!rootName.isEmpty())
-    {
-        QDomElement root = m_doc->createElement(rootName);
-        m_doc->appendChild(root);
-    }
+        if(nameLen <= 0)
+        {
+            return false;
+        }
 
-    return ret;
-}
+        while(next < 3 && (nameLen != (int)strlen(names[next]) || 0 != memcmp(data + i, names[next], nameLen)))
+        {
+            next++;
+        }
 
-bool QtXmlOperation::openDocument(QString fileName)
-{
-    bool ret = false;
+        if(next >= 3)
+        {
+            return false;
+        }
 
-    if(NULL != m_file)
-    {
-        if(m_file->isOpen())
+        i += nameLen;
+        i += QtXmlSimd::skipWhitespace(data + i, size - i);
+
+        if(i >= size || '=' != data[i])
         {
-            m_file->close();
+            return false;
         }
-        delete m_file;
-    }
 
-    m_file = new QFile(fileName);
+        i++;
+        i += QtXmlSimd::skipWhitespace(data + i, size - i);
 
-    if(m_file->exists())
-    {
-        if(m_file->open(QIODevice::ReadWrite | QIODevice::Text))
+        if(i >= size || ('"' != data[i] && '\'' != data[i]))
         {
-            m_doc->clear();
+            return false;
+        }
 
-            QString errorStr = "";
-            int errorLine = 0;
-            int errorColumn = 0;
+        int valueLen = QtXmlSimd::findByte(data + i + 1, size - i - 1, data[i]);
 
-            if(m_doc->setContent(m_file, false, &errorStr, &errorLine, &errorColumn))
-            {
-                ret = true;
-            }
-            else
-            {
-                qDebug() << "Error: Parse error at line " << errorLine << ", "
-                         << "column " << errorColumn << ": "
-                         << qPrintable(errorStr);
-            }
+        if(valueLen < 0)
+        {
+            return false;
         }
+
+        values[next] = QByteArray(data + i + 1, valueLen);
+        found[next] = true;
+        next++;
+
+        i += valueLen + 2;
     }
 
-    return ret;
-}
+    // VersionNum is "1." followed by digits
+    const QByteArray &version = values[0];
+    bool ok = found[0] && version.size() > 2 && version.startsWith("1.");
 
-bool QtXmlOperation::saveAs(QString fileName)
-{
-    bool ret = false;
+    for(int j = 2; j < version.size() && ok; j++)
+    {
+        ok = (version.at(j) >= '0' && version.at(j) <= '9');
+    }
 
-    QFile file(fileName);
+    // EncName is a letter followed by letters, digits, '.', '_' or '-'
+    const QByteArray &encoding = values[1];
 
-    // If file not exist create one
-    if (!file.exists())
+    if(found[1])
     {
-        file.open(QIODevice::WriteOnly);
-        file.close();
+        ok = ok && !encoding.isEmpty();
+
+        for(int j = 0; j < encoding.size() && ok; j++)
+        {
+            char c = encoding.at(j);
+            bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+
+            ok = letter || (j > 0 && ((c >= '0' && c <= '9') || '.' == c || '_' == c || '-' == c));
+        }
     }
 
-    // Overwrite the file
-    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    if(found[2])
     {
-        QTextStream stream(&file);
-        stream.setCodec("UTF-8");
-        m_doc->save(stream, 4);
-        file.close();
+        ok = ok && ("yes" == values[2] || "no" == values[2]);
+    }
 
-        ret = true;
+    if(!ok)
+    {
+        return false;
     }
 
-    return ret;
-}
+    QString ret = QString("version='%1'").arg(QString::fromLatin1(version.constData(), version.size()));
 
-bool QtXmlOperation::isFileExist()
-{
-    bool ret = false;
+    if(found[1])
+    {
+        ret.append(QString(" encoding='%1'").arg(QString::fromLatin1(encoding.constData(), encoding.size())));
+    }
 
-    if(NULL != m_file)
+    if(found[2])
     {
-        ret = m_file->exists();
+        ret.append(QString(" standalone='%1'").arg(QString::fromLatin1(values[2].constData(), values[2].size())));
     }
 
-    return ret;
+    *value = ret;
+
+    return true;
 }
 
-bool QtXmlOperation::isFileOpen()
+// Resolve predefined entities and character references, normalize line breaks,
+// attribute values also get tab and line breaks replaced by spaces.
+// Returns false on an unknown or malformed reference.
+static bool decodeXmlText(const char *data, int size, bool attribute, QString *text)
 {
-    bool ret = false;
+    const char *special = attribute ? "&\r\n\t" : "&\r";
+    int i = QtXmlSimd::findFirstOf(data, size, special);
 
-    if(isFileExist())
+    // Plain text, the common case
+    if(i < 0)
     {
-        if(NULL != m_file)
+        *text = QString::fromUtf8(data, size);
+        return true;
+    }
+
+    QByteArray out;
+    out.reserve(size);
+    out.append(data, i);
+
+    while(i < size)
+    {
+        char c = data[i];
+
+        if('&' == c)
         {
-            if(m_file->isOpen())
+            int end = QtXmlSimd::findByte(data + i, qMin(size - i, 16), ';');
+
+            if(end < 2)
             {
-                ret = true;
+                return false;
             }
-        }
-    }
 
-    return ret;
-}
+            QByteArray name = QByteArray::fromRawData(data + i + 1, end - 1);
 
-QString QtXmlOperation::readText(QString nodeName, int nodeIndex)
-{
-    QString ret = "";
+            if("lt" == name)
+            {
+                out.append('<');
+            }
+            else if("gt" == name)
+            {
+                out.append('>');
+            }
+            else if("amp" == name)
+            {
+                out.append('&');
+            }
+            else if("quot" == name)
+            {
+                out.append('"');
+            }
+            else if("apos" == name)
+            {
+                out.append('\'');
+            }
+            else if('#' == name.at(0) && name.size() > 1)
+            {
+                bool ok = false;
+                uint code = ('x' == name.at(1)) ? name.mid(2).toUInt(&ok, 16) : name.mid(1).toUInt(&ok, 10);
 
-    QDomElement root = m_doc->documentElement();
+                if(!ok || !appendUtf8(&out, code))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
 
-    if(!root.isNull())
-    {
-        QDomElement currentNode = findNodeByNames(nodeName, nodeIndex).toElement();
+            i += end + 1;
+        }
+        else if('\r' == c)
+        {
+            // "\r\n" and a single "\r" both become one line break
+            if(i + 1 < size && '\n' == data[i + 1])
+            {
+                i++;
+            }
 
-        if(!currentNode.isNull())
+            out.append(attribute ? ' ' : '\n');
+            i++;
+        }
+        else
         {
-            ret = currentNode.text();
+            // Tab or line break in an attribute value
+            out.append(' ');
+            i++;
+        }
+
+        int next = QtXmlSimd::findFirstOf(data + i, size - i, special);
+
+        if(next < 0)
+        {
+            next = size - i;
         }
+
+        out.append(data + i, next);
+        i += next;
     }
 
-    return ret;
+    *text = QString::fromUtf8(out.constData(), out.size());
+
+    return true;
 }
 
-QString QtXmlOperation::readAttribute(QString nodeName, QString attrName, int nodeIndex)
+// Add the attributes of a start tag, data is the tag after its name without "/>" or ">".
+// Sets unsupported for a non-ASCII attribute name.
+static bool parseXmlAttributes(const char *data, int size, QDomElement *element, qint64 *usage, bool *unsupported)
 {
-    QString ret = "";
-
-    QDomElement root = m_doc->documentElement();
+    int i = 0;
 
-    if(!root.isNull())
+    for(;;)
     {
-        QDomElement currentNode = findNodeByNames(nodeName, nodeIndex).toElement();
+        int ws = QtXmlSimd::skipWhitespace(data + i, size - i);
 
-        if(!currentNode.isNull())
+        if(i + ws >= size)
         {
-            ret = currentNode.attribute(attrName);
+            return true;
         }
-    }
 
-    return ret;
-}
+        // Attributes must be separated by whitespace
+        if(0 == ws)
+        {
+            return false;
+        }
 
-bool QtXmlOperation::insertNode(QString parentNodeName, QString nodeName, QString nodeText,
-                                QStringList attrNames, QStringList attrs, int parentIndex)
-{
-    bool ret = false;
+        i += ws;
 
-    QDomElement root = m_doc->documentElement();
-    QDomElement currentNode;
-    currentNode.clear();
+        int nameLen = QtXmlSimd::findFirstOf(data + i, size - i, "= \t\r\n");
 
-    if(!root.isNull())
-    {
-        if(!parentNodeName.isEmpty())
+        int nameCheck = (nameLen > 0) ? checkXmlName(data + i, nameLen) : 0;
+
+        if(nameCheck <= 0)
         {
-            currentNode = findNodeByNames(parentNodeName, parentIndex).toElement();
+            *unsupported = (nameCheck < 0);
+            return false;
         }
-        else
+
+        QString name = QString::fromUtf8(data + i, nameLen);
+
+        // setAttribute would silently overwrite a duplicate
+        if(element->hasAttribute(name))
         {
-            // parentNodeName = "" means insert into root node
-            currentNode = root;
+            return false;
         }
+        i += nameLen;
+        i += QtXmlSimd::skipWhitespace(data + i, size - i);
 
-        // Found parent node
-        if(!currentNode.isNull())
+        if(i >= size || '=' != data[i])
         {
-            QDomElement newNode = m_doc->createElement(nodeName);
-            currentNode.appendChild(newNode);
+            return false;
+        }
 
-            if(!nodeText.isEmpty())
-            {
-                QDomText newTextNode = m_doc->createTextNode(nodeText);
-                newNode.appendChild(newTextNode);
-            }
+        i++;
+        i += QtXmlSimd::skipWhitespace(data + i, size - i);
 
-            if (attrNames.size() > 0)
-            {
-                for (int i = 0; i < attrNames.size(); ++i)
-                {
-                    if (i < attrs.size())
-                    {
-                        newNode.setAttribute(attrNames[i], attrs[i]);
-                    }
-                    else
-                    {
-                        newNode.setAttribute(attrNames[i], "");
-                    }
-                }
-            }
+        if(i >= size || ('"' != data[i] && '\'' != data[i]))
+        {
+            return false;
+        }
 
-            ret = true;
+        int valueLen = QtXmlSimd::findByte(data + i + 1, size - i - 1, data[i]);
+
+        // "<" is not allowed in attribute values, not even inside quotes
+        if(valueLen < 0 || QtXmlSimd::findByte(data + i + 1, valueLen, '<') >= 0)
+        {
+            return false;
         }
-    }
 
-    return ret;
+        QString value;
+
+        if(!decodeXmlText(data + i + 1, valueLen, true, &value))
+        {
+            return false;
+        }
+
+        element->setAttribute(name, value);
+        *usage += XML_DOM_ATTR_BYTES + estimateString(name.size()) + estimateString(value.size());
+
+        i += valueLen + 2;
+    }
 }
 
-bool QtXmlOperation::deleteNode(QString nodeName, int nodeIndex)
+// Line and column (in characters) of a byte offset, counted from start
+static void locateXmlError(QIODevice *device, qint64 start, qint64 offset, int *errorLine, int *errorColumn)
 {
-    bool ret = false;
+    int line = 0;
+    int column = 0;
 
+    if(offset >= start && device->seek(start))
+    {
+        line = 1;
+        column = 1;
+
+        qint64 remaining = offset - start;
+
+        while(remaining > 0)
+        {
+            QByteArray chunk = device->read(qMin(remaining, (qint64)(1024 * 1024)));
+
+            if(chunk.isEmpty())
+            {
+                break;
+            }
+
+            remaining -= chunk.size();
+
+            const char *data = chunk.constData();
+            for(int i = 0; i < chunk.size(); i++)
+            {
+                if('\n' == data[i])
+                {
+                    line++;
+                    column = 1;
+                }
+                else if(0x80 != (data[i] & 0xC0))
+                {
+                    column++;
+                }
+            }
+        }
+    }
+
+    if(NULL != errorLine)
+    {
+        *errorLine = line;
+    }
+
+    if(NULL != errorColumn)
+    {
+        *errorColumn = column;
+    }
+}
+
+QtXmlOperation::QtXmlOperation() :
+    m_doc(new QDomDocument),
+    m_file(NULL),
+    m_fileGeneration(0),
+    m_sharedDoc(false),
+    m_inTransaction(false),
+    m_indexed(false),
+    m_memoryLimit(0),
+    m_parserType(ParserQDom),
+    m_readChunkSize(0),
+    m_watcher(NULL),
+    m_reloadTimer(NULL),
+    m_reloadWatcher(NULL),
+    m_reloadRunning(false),
+    m_reloadPending(false),
+    m_fileSize(-1),
+    m_asyncWatcher(NULL),
+    m_asyncRunning(false)
+{
+    m_doc->clear();
+}
+
+QtXmlOperation::QtXmlOperation(QString fileName) :
+    m_doc(new QDomDocument),
+    m_file(NULL),
+    m_fileGeneration(0),
+    m_sharedDoc(false),
+    m_inTransaction(false),
+    m_indexed(false),
+    m_memoryLimit(0),
+    m_parserType(ParserQDom),
+    m_readChunkSize(0),
+    m_watcher(NULL),
+    m_reloadTimer(NULL),
+    m_reloadWatcher(NULL),
+    m_reloadRunning(false),
+    m_reloadPending(false),
+    m_fileSize(-1),
+    m_asyncWatcher(NULL),
+    m_asyncRunning(false)
+{
+    m_doc->clear();
+
+    if(!fileName.isEmpty())
+    {
+        // Open file
+        // If not exist, create a new file
+        if(!openDocument(fileName))
+        {
+            createDocument();
+            saveAs(fileName);
+        }
+    }
+}
+
+QtXmlOperation::~QtXmlOperation()
+{
+    if(m_asyncRunning)
+    {
+        m_asyncWatcher->waitForFinished();
+        delete m_asyncWatcher->result().doc;
+    }
+
+    // Unfinished async operations are reported as canceled
+    for(int i = 0; i < m_asyncQueue.size(); i++)
+    {
+        m_asyncQueue[i].promise.reportCanceled();
+        m_asyncQueue[i].promise.reportFinished();
+    }
+
+    if(m_reloadRunning)
+    {
+        // Wait for the background reload and drop its document
+        m_reloadWatcher->waitForFinished();
+        delete m_reloadWatcher->result().doc;
+    }
+
+    if(NULL != m_file)
+    {
+        if(m_file->isOpen())
+        {
+            m_file->close();
+        }
+        delete m_file;
+    }
+
+    clearTransaction();
+
+    delete m_doc;
+}
+
+bool QtXmlOperation::createDocument(QString rootName)
+{
+    bool ret = false;
+
+    if(m_inTransaction)
+    {
+        // Keep the old document for rollback instead of clearing it
+        UndoEntry entry;
+        entry.type = UndoDocument;
+        entry.doc = m_doc;
+        entry.shared = m_sharedDoc;
+        m_undoLog.append(entry);
+
+        m_doc = new QDomDocument;
+    }
+
+    m_doc->clear();
+    m_sharedDoc = false;
+    QDomProcessingInstruction introduction = m_doc->createProcessingInstruction("xml", "version=\'1.0\' encoding=\'UTF-8\'");
+    m_doc->appendChild(introduction);
+
+    // Create root element
+    createRoot(rootName);
+
+    ret = true;
+
+    return ret;
+}
+
+bool QtXmlOperation::createRoot(QString rootName)
+{
+    bool ret = false;
+
+    // If root is not empty, append root element
+    if(!rootName.isEmpty())
+    {
+        detachDocument();
+
+        QDomElement root = m_doc->createElement(rootName);
+        m_doc->appendChild(root);
+        recordInsert(*m_doc, root);
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::openDocument(QString fileName)
+{
+    bool ret = false;
+
+    m_includePaths.clear();
+    clearIndex();
+
+    if(openFile(fileName))
+    {
+        m_doc->clear();
+        m_sharedDoc = false;
+
+        QString errorStr = "";
+        int errorLine = 0;
+        int errorColumn = 0;
+
+        if(parseDocument(m_file, m_doc, m_parserType, m_memoryLimit, m_readChunkSize, &errorStr, &errorLine, &errorColumn))
+        {
+            ret = true;
+        }
+        else
+        {
+            qDebug() << "Error: Parse error at line " << errorLine << ", "
+                     << "column " << errorColumn << ": "
+                     << qPrintable(errorStr);
+        }
+    }
+
+    updateFileStamp();
+    updateWatchPath();
+
+    return ret;
+}
+
+bool QtXmlOperation::openDocument(QString fileName, QStringList includePaths)
+{
+    bool ret = false;
+
+    if(includePaths.isEmpty())
+    {
+        return openDocument(fileName);
+    }
+
+    m_includePaths = includePaths;
+    clearIndex();
+
+    if(openFile(fileName))
+    {
+        m_doc->clear();
+        m_sharedDoc = false;
+
+        QString errorStr = "";
+        int errorLine = 0;
+        int errorColumn = 0;
+
+        if(parseFiltered(m_file, m_doc, includePaths, m_memoryLimit, &errorStr, &errorLine, &errorColumn))
+        {
+            ret = true;
+        }
+        else
+        {
+            qDebug() << "Error: Parse error at line " << errorLine << ", "
+                     << "column " << errorColumn << ": "
+                     << qPrintable(errorStr);
+        }
+    }
+
+    updateFileStamp();
+    updateWatchPath();
+
+    return ret;
+}
+
+bool QtXmlOperation::saveAs(QString fileName)
+{
+    return saveDocument(*m_doc, fileName);
+}
+
+bool QtXmlOperation::validateDocument(QString fileName, QStringList requiredPaths, int maxElements,
+                                      QString *errorStr, int *errorLine, int *errorColumn)
+{
+    bool ret = false;
+
+    QString error = "";
+    qint64 line = 0;
+    qint64 column = 0;
+
+    // "\\W+", use any sequence of non-word characters as the separator
+    QList<QStringList> paths;
+    QSet<QString> missing;
+    for(int i = 0; i < requiredPaths.size(); i++)
+    {
+        QStringList tags = requiredPaths.at(i).split(QRegExp("\\W+"), QString::SkipEmptyParts);
+
+        if(!tags.isEmpty())
+        {
+            paths.append(tags);
+            missing.insert(tags.join("/"));
+        }
+    }
+
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        error = file.errorString();
+    }
+    else
+    {
+        QXmlStreamReader reader(&file);
+        reader.setNamespaceProcessing(false);
+
+        // Like getNodeCount a path starts at any element named by its first tag and
+        // follows the first child of each further tag. Per open element: the
+        // (path, tag) pairs it matched, and whether the next tag's child was seen
+        QList<QVector<QPair<int, int> > > chainStack;
+        QList<QVector<bool> > childStack;
+        int elementCount = 0;
+
+        while(!reader.atEnd())
+        {
+            QXmlStreamReader::TokenType token = reader.readNext();
+
+            if(QXmlStreamReader::StartElement == token)
+            {
+                elementCount++;
+
+                if(maxElements > 0 && elementCount > maxElements)
+                {
+                    reader.raiseError(QString("More than %1 elements").arg(maxElements));
+                    break;
+                }
+
+                QVector<QPair<int, int> > chains;
+
+                // Paths are only tracked while some required path is not seen yet
+                if(!missing.isEmpty())
+                {
+                    QString name = reader.qualifiedName().toString();
+                    QVector<QPair<int, int> > matched;
+
+                    if(!chainStack.isEmpty())
+                    {
+                        const QVector<QPair<int, int> > &parent = chainStack.last();
+                        QVector<bool> &childSeen = childStack.last();
+
+                        for(int i = 0; i < parent.size(); i++)
+                        {
+                            if(!childSeen.at(i) && paths.at(parent.at(i).first).at(parent.at(i).second + 1) == name)
+                            {
+                                childSeen[i] = true;
+                                matched.append(qMakePair(parent.at(i).first, parent.at(i).second + 1));
+                            }
+                        }
+                    }
+
+                    for(int i = 0; i < paths.size(); i++)
+                    {
+                        if(paths.at(i).at(0) == name)
+                        {
+                            matched.append(qMakePair(i, 0));
+                        }
+                    }
+
+                    for(int i = 0; i < matched.size(); i++)
+                    {
+                        const QStringList &tags = paths.at(matched.at(i).first);
+
+                        if(matched.at(i).second + 1 == tags.size())
+                        {
+                            missing.remove(tags.join("/"));
+                        }
+                        else
+                        {
+                            chains.append(matched.at(i));
+                        }
+                    }
+                }
+
+                chainStack.append(chains);
+                childStack.append(QVector<bool>(chains.size(), false));
+            }
+            else if(QXmlStreamReader::EndElement == token)
+            {
+                chainStack.removeLast();
+                childStack.removeLast();
+            }
+        }
+
+        if(reader.hasError())
+        {
+            error = reader.errorString();
+            line = reader.lineNumber();
+            column = reader.columnNumber();
+        }
+        else if(0 == elementCount)
+        {
+            error = "No root element";
+        }
+        else if(!missing.isEmpty())
+        {
+            QStringList paths = missing.toList();
+            qSort(paths);
+            error = QString("Missing %1").arg(paths.join(", "));
+        }
+        else
+        {
+            ret = true;
+        }
+    }
+
+    if(NULL != errorStr)
+    {
+        *errorStr = error;
+    }
+
+    if(NULL != errorLine)
+    {
+        *errorLine = (int)line;
+    }
+
+    if(NULL != errorColumn)
+    {
+        *errorColumn = (int)column;
+    }
+
+    return ret;
+}
+
+qint64 QtXmlOperation::exportRecords(QString fileName, QString recordPath, QStringList columns, QString outputName,
+                                     ExportFormat format, QString *errorStr)
+{
+    qint64 ret = -1;
+    QString error = "";
+
+    // "\\W+", use any sequence of non-word characters as the separator
+    QString record = recordPath.split(QRegExp("\\W+"), QString::SkipEmptyParts).join("/");
+    QString recordSuffix = "/" + record;
+
+    // Split columns into child path relative to the record and attribute name
+    QStringList childPaths;
+    QStringList attrNames;
+    for(int i = 0; i < columns.size(); i++)
+    {
+        QString column = columns.at(i).trimmed();
+        QString attr = "";
+        int at = column.lastIndexOf('@');
+
+        if(at >= 0)
+        {
+            attr = column.mid(at + 1);
+            column = column.left(at);
+        }
+
+        // "." is the record itself
+        if("." == column)
+        {
+            column = "";
+        }
+
+        childPaths.append(column.split(QRegExp("\\W+"), QString::SkipEmptyParts).join("/"));
+        attrNames.append(attr);
+    }
+
+    QFile file(fileName);
+    QFile output(outputName);
+
+    if(record.isEmpty() || columns.isEmpty())
+    {
+        error = "Empty record path or columns";
+    }
+    else if(!file.open(QIODevice::ReadOnly))
+    {
+        error = file.errorString();
+    }
+    else if(!output.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        error = output.errorString();
+    }
+    else
+    {
+        QTextStream stream(&output);
+        stream.setCodec("UTF-8");
+
+        if(ExportCsv == format)
+        {
+            writeRecord(stream, columns, columns, format);
+        }
+
+        QXmlStreamReader reader(&file);
+        reader.setNamespaceProcessing(false);
+
+        QStringList pathStack;      // Full paths outside the record, relative paths inside
+        int recordDepth = 0;        // Depth of the current record, 0: outside
+        QStringList values;
+        QVector<bool> found;        // Column got its value (first match wins)
+        QVector<int> textDepth;     // Depth of the element whose text is collected, 0: none
+        qint64 count = 0;
+
+        while(!reader.atEnd())
+        {
+            QXmlStreamReader::TokenType token = reader.readNext();
+
+            if(QXmlStreamReader::StartElement == token)
+            {
+                QString name = reader.qualifiedName().toString();
+
+                if(0 == recordDepth)
+                {
+                    QString path = pathStack.isEmpty() ? name : (pathStack.last() + "/" + name);
+                    pathStack.append(path);
+
+                    // Like readAll the record path may start at any depth
+                    if(path != record && !path.endsWith(recordSuffix))
+                    {
+                        continue;
+                    }
+
+                    recordDepth = pathStack.size();
+                    values.clear();
+                    for(int i = 0; i < columns.size(); i++)
+                    {
+                        values.append(QString());
+                    }
+                    found.fill(false, columns.size());
+                    textDepth.fill(0, columns.size());
+                }
+                else
+                {
+                    QString path = (pathStack.size() == recordDepth) ? name : (pathStack.last() + "/" + name);
+                    pathStack.append(path);
+                }
+
+                // Relative path of this element inside the record, empty for the record
+                QString relPath = (pathStack.size() == recordDepth) ? QString("") : pathStack.last();
+
+                for(int i = 0; i < columns.size(); i++)
+                {
+                    if(found.at(i) || childPaths.at(i) != relPath)
+                    {
+                        continue;
+                    }
+
+                    if(attrNames.at(i).isEmpty())
+                    {
+                        textDepth[i] = pathStack.size();
+                    }
+                    else
+                    {
+                        values[i] = reader.attributes().value(attrNames.at(i)).toString();
+                    }
+
+                    found[i] = true;
+                }
+            }
+            else if(QXmlStreamReader::Characters == token && recordDepth > 0
+                    && (reader.isCDATA() || !reader.isWhitespace()))
+            {
+                // Indentation is dropped like openDocument does, readText gives the same text
+                for(int i = 0; i < columns.size(); i++)
+                {
+                    if(textDepth.at(i) > 0)
+                    {
+                        values[i].append(reader.text());
+                    }
+                }
+            }
+            else if(QXmlStreamReader::EndElement == token)
+            {
+                if(recordDepth > 0)
+                {
+                    for(int i = 0; i < columns.size(); i++)
+                    {
+                        if(textDepth.at(i) == pathStack.size())
+                        {
+                            textDepth[i] = 0;
+                        }
+                    }
+
+                    if(recordDepth == pathStack.size())
+                    {
+                        writeRecord(stream, columns, values, format);
+                        recordDepth = 0;
+                        count++;
+                    }
+                }
+
+                pathStack.removeLast();
+            }
+        }
+
+        stream.flush();
+        output.close();
+
+        if(reader.hasError())
+        {
+            error = QString("Parse error at line %1, column %2: %3")
+                    .arg(reader.lineNumber())
+                    .arg(reader.columnNumber())
+                    .arg(reader.errorString());
+
+            // Do not leave a truncated export behind
+            output.remove();
+        }
+        else if(0 == count)
+        {
+            error = "No element matches the record path";
+
+            output.remove();
+        }
+        else
+        {
+            ret = count;
+        }
+    }
+
+    if(NULL != errorStr)
+    {
+        *errorStr = error;
+    }
+
+    return ret;
+}
+
+void QtXmlOperation::writeRecord(QTextStream &stream, QStringList columns, QStringList values, ExportFormat format)
+{
+    if(ExportCsv == format)
+    {
+        for(int i = 0; i < values.size(); i++)
+        {
+            QString value = values.at(i);
+
+            if(i > 0)
+            {
+                stream << ',';
+            }
+
+            // Quote fields containing separator, quote or line break
+            if(value.contains(',') || value.contains('"') || value.contains('\n') || value.contains('\r'))
+            {
+                value.replace("\"", "\"\"");
+                stream << '"' << value << '"';
+            }
+            else
+            {
+                stream << value;
+            }
+        }
+    }
+    else
+    {
+        stream << '{';
+
+        for(int i = 0; i < values.size(); i++)
+        {
+            if(i > 0)
+            {
+                stream << ',';
+            }
+
+            // Column names and values as JSON strings
+            for(int k = 0; k < 2; k++)
+            {
+                QString text = (0 == k) ? columns.at(i) : values.at(i);
+                QString escaped = "";
+                escaped.reserve(text.size() + 2);
+
+                for(int j = 0; j < text.size(); j++)
+                {
+                    QChar c = text.at(j);
+
+                    if('"' == c || '\\' == c)
+                    {
+                        escaped.append('\\');
+                        escaped.append(c);
+                    }
+                    else if('\n' == c)
+                    {
+                        escaped.append("\\n");
+                    }
+                    else if('\r' == c)
+                    {
+                        escaped.append("\\r");
+                    }
+                    else if('\t' == c)
+                    {
+                        escaped.append("\\t");
+                    }
+                    else if(c.unicode() < 0x20)
+                    {
+                        escaped.append(QString("\\u%1").arg((int)c.unicode(), 4, 16, QChar('0')));
+                    }
+                    else
+                    {
+                        escaped.append(c);
+                    }
+                }
+
+                stream << '"' << escaped << '"';
+
+                if(0 == k)
+                {
+                    stream << ':';
+                }
+            }
+        }
+
+        stream << '}';
+    }
+
+    stream << '\n';
+}
+
+int QtXmlOperation::splitDocument(QString fileName, QString recordName, QString outputName, int recordsPerShard,
+                                  qint64 bytesPerShard, QString *errorStr)
+{
+    QFile file(fileName);
+    QString error = "";
+
+    // Binary mode, records are copied byte for byte
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        if(NULL != errorStr)
+        {
+            *errorStr = file.errorString();
+        }
+        return -1;
+    }
+
+    // Indentation and the root end tag are written as ASCII
+    QByteArray magic = file.peek(4);
+    if(magic.startsWith("\xFE\xFF") || magic.startsWith("\xFF\xFE") || magic.contains('\0'))
+    {
+        if(NULL != errorStr)
+        {
+            *errorStr = "UTF-16 and UTF-32 files can not be split";
+        }
+        return -1;
+    }
+
+    QFileInfo outputInfo(outputName);
+    QString shardPattern = outputInfo.path() + "/" + outputInfo.completeBaseName() + "_%1."
+            + (outputInfo.suffix().isEmpty() ? QString("xml") : outputInfo.suffix());
+
+    QByteArray record = recordName.toUtf8();
+
+    // Children after the last record end every shard, measure them first so
+    // the byte limit covers the whole shard
+    qint64 footerSize = 0;
+    if(bytesPerShard > 0)
+    {
+        footerSize = measureSplitFooter(&file, record);
+
+        if(!file.seek(0))
+        {
+            if(NULL != errorStr)
+            {
+                *errorStr = file.errorString();
+            }
+            return -1;
+        }
+    }
+
+    QtXmlScanner scanner(&file);
+
+    QList<QByteArray> tagStack;     // Names of the open elements
+    QByteArray prolog;              // Bytes before the root start tag
+    QByteArray rootStart;
+    QByteArray header;              // Root children before the first record
+    QByteArray head;                // Start of every shard, set at the first record
+    QByteArray tail;
+    QByteArray child;               // Root child being read
+    bool childIsRecord = false;
+    QByteArray body;                // Records of the current shard
+    int bodyRecords = 0;
+    QByteArray pending;             // Root children after the last record, the footer
+                                    // of every shard unless another record follows
+
+    QStringList shardNames;
+    QList<QFuture<QString> > writes;
+    int finishedWrites = 0;
+    int maxWrites = qMax(QThread::idealThreadCount(), 1);
+
+    for(;;)
+    {
+        QtXmlScanner::TokenType token = scanner.readNext();
+
+        if(QtXmlScanner::EndOfFile == token)
+        {
+            if(!tagStack.isEmpty() || rootStart.isEmpty())
+            {
+                error = "Unexpected end of file";
+            }
+            break;
+        }
+
+        if(QtXmlScanner::Error == token)
+        {
+            error = scanner.errorString();
+            break;
+        }
+
+        QByteArray data = scanner.tokenData();
+        int depth = tagStack.size();
+
+        if(rootStart.isEmpty())
+        {
+            // Prolog: declaration, comments, DOCTYPE
+            // tokenData() points into the scanner buffer, copy what is kept
+            if(QtXmlScanner::StartElement == token)
+            {
+                rootStart = QByteArray(data.constData(), data.size());
+                tagStack.append(scanner.name());
+                tail = "\n</" + scanner.name() + ">\n";
+            }
+            else if(QtXmlScanner::EmptyElement == token)
+            {
+                // Root without children, one shard holding it, what follows is still checked
+                rootStart = QByteArray(data.constData(), data.size());
+            }
+            else
+            {
+                prolog.append(data.constData(), data.size());
+            }
+            continue;
+        }
+
+        if(0 == depth)
+        {
+            // Only whitespace, comments and processing instructions may follow the root
+            if(QtXmlScanner::StartElement == token || QtXmlScanner::EmptyElement == token
+               || (QtXmlScanner::Text == token && QtXmlSimd::skipWhitespace(data.constData(), data.size()) < data.size()))
+            {
+                error = QString("Extra content after the root element at offset %1").arg(scanner.tokenBegin());
+                break;
+            }
+            continue;
+        }
+
+        if(1 == depth && child.isEmpty())
+        {
+            if(QtXmlScanner::Text == token && QtXmlSimd::skipWhitespace(data.constData(), data.size()) == data.size())
+            {
+                // Indentation between root children, shards are indented again
+                continue;
+            }
+
+            if(QtXmlScanner::EndElement == token)
+            {
+                if(tagStack.last() != scanner.name())
+                {
+                    error = QString("Unexpected end tag at offset %1").arg(scanner.tokenBegin());
+                    break;
+                }
+
+                tagStack.removeLast();
+                continue;
+            }
+
+            childIsRecord = ((QtXmlScanner::StartElement == token || QtXmlScanner::EmptyElement == token)
+                             && (record.isEmpty() || record == scanner.name()));
+
+            // Text directly below the root is copied as it is, other children are indented
+            child = (QtXmlScanner::Text == token) ? QByteArray() : QByteArray("\n    ");
+        }
+
+        child.append(data.constData(), data.size());
+
+        if(QtXmlScanner::StartElement == token)
+        {
+            tagStack.append(scanner.name());
+        }
+        else if(QtXmlScanner::EndElement == token)
+        {
+            if(tagStack.last() != scanner.name())
+            {
+                error = QString("Unexpected end tag at offset %1").arg(scanner.tokenBegin());
+                break;
+            }
+
+            tagStack.removeLast();
+        }
+
+        // Root child not complete yet
+        if(tagStack.size() > 1)
+        {
+            continue;
+        }
+
+        if(head.isEmpty() && !childIsRecord)
+        {
+            header.append(child);
+        }
+        else
+        {
+            if(head.isEmpty())
+            {
+                head = prolog + rootStart + header;
+            }
+
+            if(!childIsRecord)
+            {
+                pending.append(child);
+            }
+            else
+            {
+                // Start a new shard before the record would break a limit, the
+                // footer added to every shard later is counted in
+                if(bodyRecords > 0
+                   && ((recordsPerShard > 0 && bodyRecords >= recordsPerShard)
+                       || (bytesPerShard > 0 && head.size() + body.size() + pending.size() + child.size()
+                           + footerSize + tail.size() > bytesPerShard)))
+                {
+                    // Limit memory to the shards being written
+                    while(writes.size() - finishedWrites >= maxWrites && error.isEmpty())
+                    {
+                        error = writes.at(finishedWrites++).result();
+                    }
+
+                    shardNames.append(shardPattern.arg(shardNames.size() + 1, 4, 10, QChar('0')));
+                    writes.append(QtConcurrent::run(&QtXmlOperation::writeShard, shardNames.last(), head, body, tail));
+
+                    body = QByteArray();
+                    bodyRecords = 0;
+                }
+
+                // Children between two records stay in document order
+                body.append(pending);
+                pending = QByteArray();
+
+                body.append(child);
+                bodyRecords++;
+            }
+        }
+
+        child = QByteArray();
+
+        if(!error.isEmpty())
+        {
+            break;
+        }
+    }
+
+    // Shards written so far end with tail, the footer is added once known
+    int shardsWithoutFooter = shardNames.size();
+
+    // Remaining records, or the only shard of a document without records
+    if(error.isEmpty() && (!body.isEmpty() || shardNames.isEmpty()))
+    {
+        if(head.isEmpty())
+        {
+            head = prolog + rootStart + header;
+        }
+
+        if(tail.isEmpty())
+        {
+            // Empty root element "<root/>" is kept as it is
+            tail = "\n";
+        }
+
+        shardNames.append(shardPattern.arg(shardNames.size() + 1, 4, 10, QChar('0')));
+        writes.append(QtConcurrent::run(&QtXmlOperation::writeShard, shardNames.last(), head, body, pending + tail));
+    }
+
+    // Wait for every write, the files are removed on failure
+    for(int i = finishedWrites; i < writes.size(); i++)
+    {
+        QString writeError = writes.at(i).result();
+
+        if(error.isEmpty())
+        {
+            error = writeError;
+        }
+    }
+
+    // Children after the last record are copied into every shard like the header
+    if(error.isEmpty() && !pending.isEmpty() && shardsWithoutFooter > 0)
+    {
+        QList<QFuture<QString> > footers;
+
+        for(int i = 0; i < shardsWithoutFooter; i++)
+        {
+            footers.append(QtConcurrent::run(&QtXmlOperation::replaceShardTail, shardNames.at(i), tail.size(), pending + tail));
+        }
+
+        for(int i = 0; i < footers.size(); i++)
+        {
+            QString footerError = footers.at(i).result();
+
+            if(error.isEmpty())
+            {
+                error = footerError;
+            }
+        }
+    }
+
+    if(!error.isEmpty())
+    {
+        for(int i = 0; i < shardNames.size(); i++)
+        {
+            QFile::remove(shardNames.at(i));
+        }
+
+        if(NULL != errorStr)
+        {
+            *errorStr = error;
+        }
+
+        return -1;
+    }
+
+    return shardNames.size();
+}
+
+qint64 QtXmlOperation::measureSplitFooter(QIODevice *device, QByteArray record)
+{
+    QtXmlScanner scanner(device);
+    qint64 footer = 0;
+    qint64 child = -1;          // Bytes of the root child being read, -1: between children
+    bool childIsRecord = false;
+    bool rootSeen = false;
+    int depth = 0;
+
+    // Same root children as splitDocument copies, errors are reported by splitDocument
+    for(;;)
+    {
+        QtXmlScanner::TokenType token = scanner.readNext();
+
+        if(QtXmlScanner::EndOfFile == token || QtXmlScanner::Error == token)
+        {
+            break;
+        }
+
+        QByteArray data = scanner.tokenData();
+
+        if(!rootSeen)
+        {
+            if(QtXmlScanner::EmptyElement == token)
+            {
+                break;
+            }
+
+            if(QtXmlScanner::StartElement == token)
+            {
+                rootSeen = true;
+                depth = 1;
+            }
+            continue;
+        }
+
+        if(0 == depth)
+        {
+            break;
+        }
+
+        if(1 == depth && child < 0)
+        {
+            if(QtXmlScanner::Text == token && QtXmlSimd::skipWhitespace(data.constData(), data.size()) == data.size())
+            {
+                continue;
+            }
+
+            if(QtXmlScanner::EndElement == token)
+            {
+                depth = 0;
+                continue;
+            }
+
+            childIsRecord = ((QtXmlScanner::StartElement == token || QtXmlScanner::EmptyElement == token)
+                             && (record.isEmpty() || record == scanner.name()));
+
+            // Indentation splitDocument writes before the child
+            child = (QtXmlScanner::Text == token) ? 0 : 5;
+        }
+
+        child += data.size();
+
+        if(QtXmlScanner::StartElement == token)
+        {
+            depth++;
+        }
+        else if(QtXmlScanner::EndElement == token)
+        {
+            depth--;
+        }
+
+        if(depth > 1)
+        {
+            continue;
+        }
+
+        footer = childIsRecord ? 0 : (footer + child);
+        child = -1;
+    }
+
+    return footer;
+}
+
+QString QtXmlOperation::writeShard(QString fileName, QByteArray head, QByteArray body, QByteArray tail)
+{
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        return QString("%1: %2").arg(fileName).arg(file.errorString());
+    }
+
+    if(file.write(head) != head.size() || file.write(body) != body.size() || file.write(tail) != tail.size())
+    {
+        return QString("%1: %2").arg(fileName).arg(file.errorString());
+    }
+
+    file.close();
+
+    return QString();
+}
+
+QString QtXmlOperation::replaceShardTail(QString fileName, int tailSize, QByteArray tail)
+{
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::ReadWrite) || !file.resize(file.size() - tailSize)
+       || !file.seek(file.size()) || file.write(tail) != tail.size())
+    {
+        return QString("%1: %2").arg(fileName).arg(file.errorString());
+    }
+
+    file.close();
+
+    return QString();
+}
+
+QFuture<bool> QtXmlOperation::openDocumentAsync(QString fileName)
+{
+    AsyncOperation op;
+    op.save = false;
+    op.fileName = fileName;
+    op.wasShared = false;
+    op.promise.reportStarted();
+
+    // The swap ends the transaction, refuse instead of dropping its undo log
+    if(m_inTransaction)
+    {
+        QString errorStr = "Can not open a document during a transaction";
+
+        op.promise.reportResult(false);
+        op.promise.reportFinished();
+        emit failed(fileName, errorStr);
+
+        return op.promise.future();
+    }
+
+    m_asyncQueue.append(op);
+    startAsyncOperation();
+
+    return op.promise.future();
+}
+
+QFuture<bool> QtXmlOperation::saveAsync(QString fileName)
+{
+    AsyncOperation op;
+    op.save = true;
+    op.fileName = fileName;
+    op.promise.reportStarted();
+
+    if(m_inTransaction)
+    {
+        // Undo log refers to nodes of m_doc, so m_doc must not be swapped by a
+        // copy on write, save a copy instead
+        op.doc = m_doc->cloneNode(true).toDocument();
+        op.wasShared = false;
+    }
+    else
+    {
+        // Share the tree with the worker, the next change copies it first
+        op.doc = *m_doc;
+        op.wasShared = m_sharedDoc;
+
+        for(int i = 0; i < m_asyncQueue.size(); i++)
+        {
+            if(m_asyncQueue.at(i).save && m_asyncQueue.at(i).doc == op.doc)
+            {
+                op.wasShared = m_asyncQueue.at(i).wasShared;
+                break;
+            }
+        }
+
+        m_sharedDoc = true;
+    }
+
+    m_asyncQueue.append(op);
+    startAsyncOperation();
+
+    return op.promise.future();
+}
+
+bool QtXmlOperation::openIndex(QString fileName)
+{
+    bool ret = false;
+
+    clearTransaction();
+    m_includePaths.clear();
+    clearIndex();
+    m_doc->clear();
+    m_sharedDoc = false;
+
+    if(openFile(fileName))
+    {
+        QString errorStr = "";
+
+        if(reloadIndex(&errorStr))
+        {
+            m_indexed = true;
+            ret = true;
+        }
+        else
+        {
+            qDebug() << "Error: Index failed: " << qPrintable(errorStr);
+        }
+    }
+
+    updateFileStamp();
+    updateWatchPath();
+
+    return ret;
+}
+
+bool QtXmlOperation::isIndexed()
+{
+    return m_indexed;
+}
+
+bool QtXmlOperation::openCachedDocument(QString fileName)
+{
+    bool ret = false;
+
+    m_includePaths.clear();
+    clearIndex();
+
+    if(openFile(fileName))
+    {
+        qint64 cost = 0;
+
+        m_doc->clear();
+        *m_doc = QtXmlDocumentCache::instance()->document(fileName, &ret, &cost);
+        m_sharedDoc = ret;
+
+        // The shared tree is parsed once for all instances, apply this instance's limit to it
+        if(ret && m_memoryLimit > 0 && cost > m_memoryLimit)
+        {
+            qDebug() << "Error: Memory limit of " << m_memoryLimit << " bytes exceeded";
+
+            m_doc->clear();
+            m_sharedDoc = false;
+            ret = false;
+        }
+    }
+
+    updateFileStamp();
+    updateWatchPath();
+
+    return ret;
+}
+
+bool QtXmlOperation::isFileExist()
+{
+    bool ret = false;
+
+    if(NULL != m_file)
+    {
+        ret = m_file->exists();
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::isFileOpen()
+{
+    bool ret = false;
+
+    if(isFileExist())
+    {
+        if(NULL != m_file)
+        {
+            if(m_file->isOpen())
+            {
+                ret = true;
+            }
+        }
+    }
+
+    return ret;
+}
+
+QString QtXmlOperation::readText(QString nodeName, int nodeIndex)
+{
+    QString ret = "";
+
+    QDomElement root = m_doc->documentElement();
+
+    if(!root.isNull())
+    {
+        QDomElement currentNode = findNodeByNames(nodeName, nodeIndex).toElement();
+
+        if(!currentNode.isNull())
+        {
+            ret = currentNode.text();
+        }
+    }
+    else if(m_indexed)
+    {
+        QDomDocument fragment;
+
+        if(readIndexedElement(nodeName, nodeIndex, &fragment))
+        {
+            ret = fragment.documentElement().text();
+        }
+    }
+
+    return ret;
+}
+
+QString QtXmlOperation::readAttribute(QString nodeName, QString attrName, int nodeIndex)
+{
+    QString ret = "";
+
+    QDomElement root = m_doc->documentElement();
+
+    if(!root.isNull())
+    {
+        QDomElement currentNode = findNodeByNames(nodeName, nodeIndex).toElement();
+
+        if(!currentNode.isNull())
+        {
+            ret = currentNode.attribute(attrName);
+        }
+    }
+    else if(m_indexed)
+    {
+        QDomDocument fragment;
+
+        if(readIndexedElement(nodeName, nodeIndex, &fragment))
+        {
+            ret = fragment.documentElement().attribute(attrName);
+        }
+    }
+
+    return ret;
+}
+
+QStringList QtXmlOperation::readAll(QString nodeNames, QString attrName)
+{
+    QStringList ret;
+
+    if(!m_doc->documentElement().isNull())
+    {
+        QList<QDomElement> elements = findAllByNames(nodeNames, NULL, NULL, false);
+
+        for(int i = 0; i < elements.size(); i++)
+        {
+            ret.append(attrName.isEmpty() ? elements.at(i).text() : elements.at(i).attribute(attrName));
+        }
+    }
+    else if(m_indexed && NULL != m_file)
+    {
+        // Read every indexed range through one file handle
+        QVector<qint64> ranges = findIndexRanges(nodeNames);
+        QFile file(m_file->fileName());
+
+        if(!ranges.isEmpty() && file.open(QIODevice::ReadOnly))
+        {
+            for(int i = 0; i + 1 < ranges.size(); i += 2)
+            {
+                QDomDocument fragment;
+                QString value = "";
+
+                if(file.seek(ranges.at(i))
+                        && fragment.setContent(m_indexProlog + file.read(ranges.at(i + 1) - ranges.at(i)), false))
+                {
+                    QDomElement element = fragment.documentElement();
+                    value = attrName.isEmpty() ? element.text() : element.attribute(attrName);
+                }
+
+                ret.append(value);
+            }
+        }
+    }
+
+    return ret;
+}
+
+int QtXmlOperation::countAll(QString nodeNames)
+{
+    int ret = 0;
+
+    if(!m_doc->documentElement().isNull())
+    {
+        ret = findAllByNames(nodeNames, NULL, NULL, false).size();
+    }
+    else if(m_indexed)
+    {
+        ret = findIndexRanges(nodeNames).size() / 2;
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::insertNode(QString parentNodeName, QString nodeName, QString nodeText,
+                                QStringList attrNames, QStringList attrs, int parentIndex)
+{
+    bool ret = false;
+
+    detachDocument();
+
+    QDomElement root = m_doc->documentElement();
+    QDomElement currentNode;
+    currentNode.clear();
+
+    if(!root.isNull())
+    {
+        if(!parentNodeName.isEmpty())
+        {
+            currentNode = findNodeByNames(parentNodeName, parentIndex).toElement();
+        }
+        else
+        {
+            // parentNodeName = "" means insert into root node
+            currentNode = root;
+        }
+
+        // Found parent node
+        if(!currentNode.isNull())
+        {
+            QDomElement newNode = m_doc->createElement(nodeName);
+            currentNode.appendChild(newNode);
+            recordInsert(currentNode, newNode);
+
+            if(!nodeText.isEmpty())
+            {
+                QDomText newTextNode = m_doc->createTextNode(nodeText);
+                newNode.appendChild(newTextNode);
+            }
+
+            if (attrNames.size() > 0)
+            {
+                for (int i = 0; i < attrNames.size(); ++i)
+                {
+                    if (i < attrs.size())
+                    {
+                        newNode.setAttribute(attrNames[i], attrs[i]);
+                    }
+                    else
+                    {
+                        newNode.setAttribute(attrNames[i], "");
+                    }
+                }
+            }
+
+            ret = true;
+        }
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::deleteNode(QString nodeName, int nodeIndex)
+{
+    bool ret = false;
+
+    detachDocument();
+
+    QDomElement root = m_doc->documentElement();
+    QDomElement currentNode;
+    currentNode.clear();
+
+    if(root.tagName() != nodeName)
+    {
+        currentNode = findNodeByNames(nodeName, nodeIndex).toElement();
+
+        if(!currentNode.isNull())
+        {
+            QDomElement parentNode = currentNode.parentNode().toElement();
+
+            if(!parentNode.isNull())
+            {
+                recordRemove(parentNode, currentNode);
+                parentNode.removeChild(currentNode);
+            }
+            else
+            {
+                recordRemove(*m_doc, root);
+                m_doc->removeChild(root);
+            }
+
+            ret = true;
+        }
+    }
+    else
+    {
+        recordRemove(*m_doc, root);
+        m_doc->removeChild(root);
+        ret = true;
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::replaceNode(QString parentNodeName, QString nodeName, QString nodeText, QStringList attrNames, QStringList attrs, int parentIndex)
+{
+    bool ret = false;
+
+    // Run inside a transaction so a failed insert restores the deleted node,
+    // started directly since beginTransaction refuses while an open is pending
+    bool ownTransaction = !m_inTransaction;
+    if(ownTransaction)
+    {
+        m_undoLog.clear();
+        m_inTransaction = true;
+    }
+    int savepoint = m_undoLog.size();
+
+    if(deleteNode(nodeName, parentIndex))
+    {
+        ret = insertNode(parentNodeName, nodeName, nodeText, attrNames, attrs, parentIndex);
+    }
+
+    if(!ret)
+    {
+        rollbackTo(savepoint);
+    }
+
+    if(ownTransaction)
+    {
+        commitTransaction();
+    }
+
+    return ret;
+}
+
+int QtXmlOperation::deleteAll(QString nodeNames, NodePredicate predicate, void *context)
+{
+    detachDocument();
+
+    // Collect first, removing while walking would break the traversal.
+    // Elements below a deleted one are gone with it and are not collected.
+    QList<QDomElement> matches = findAllByNames(nodeNames, predicate, context, true);
+
+    for(int i = 0; i < matches.size(); i++)
+    {
+        QDomNode parentNode = matches.at(i).parentNode();
+
+        recordRemove(parentNode, matches.at(i));
+        parentNode.removeChild(matches.at(i));
+    }
+
+    return matches.size();
+}
+
+int QtXmlOperation::updateAll(QString nodeNames, QStringList attrNames, QStringList attrs, QString nodeText,
+                              NodePredicate predicate, void *context)
+{
+    detachDocument();
+
+    QList<QDomElement> matches = findAllByNames(nodeNames, predicate, context, false);
+
+    for(int i = 0; i < matches.size(); i++)
+    {
+        QDomElement element = matches.at(i);
+
+        if(!attrNames.isEmpty())
+        {
+            recordAttributes(element);
+
+            for(int j = 0; j < attrNames.size(); j++)
+            {
+                element.setAttribute(attrNames.at(j), (j < attrs.size()) ? attrs.at(j) : QString(""));
+            }
+        }
+
+        if(!nodeText.isNull())
+        {
+            // Replace text and CDATA children, child elements are kept
+            QDomNode child = element.firstChild();
+
+            while(!child.isNull())
+            {
+                QDomNode next = child.nextSibling();
+
+                if(child.isText())
+                {
+                    recordRemove(element, child);
+                    element.removeChild(child);
+                }
+
+                child = next;
+            }
+
+            if(!nodeText.isEmpty())
+            {
+                QDomText newTextNode = m_doc->createTextNode(nodeText);
+                element.appendChild(newTextNode);
+                recordInsert(element, newTextNode);
+            }
+        }
+    }
+
+    return matches.size();
+}
+
+bool QtXmlOperation::beginTransaction()
+{
+    bool ret = false;
+
+    // A pending open swaps the document and would drop the transaction silently
+    if(!m_inTransaction && !isOpenPending())
+    {
+        m_undoLog.clear();
+        m_inTransaction = true;
+        ret = true;
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::commitTransaction()
+{
+    bool ret = false;
+
+    if(m_inTransaction)
+    {
+        clearTransaction();
+        ret = true;
+
+        // Reload postponed during the transaction
+        if(isWatchEnabled() && m_reloadPending)
+        {
+            m_reloadPending = false;
+            m_reloadTimer->start();
+        }
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::rollbackTransaction()
+{
+    bool ret = false;
+
+    if(m_inTransaction)
+    {
+        rollbackTo(0);
+        clearTransaction();
+        ret = true;
+
+        // Reload postponed during the transaction
+        if(isWatchEnabled() && m_reloadPending)
+        {
+            m_reloadPending = false;
+            m_reloadTimer->start();
+        }
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::isInTransaction()
+{
+    return m_inTransaction;
+}
+
+QDomNode QtXmlOperation::findNodeByNames(QString nodeNames, int index)
+{
+    QDomNode retNode;
+    retNode.clear();
+    int foundNodeNum = 0;
+
+    if(!nodeNames.isEmpty())
+    {
+        // "\\W+", use any sequence of non-word characters as the separator
+        QStringList tags = nodeNames.split(QRegExp("\\W+"), QString::SkipEmptyParts);
+        QDomNodeList lists = m_doc->elementsByTagName(tags.at(0));
+        QDomNode curretNode;
+
+        //qDebug() << __FUNCTION__ << "(): " << "tags = " << tags;
+
+        if(tags.size() > 1)
+        {
+            for(int cnt = 0; cnt < lists.size(); cnt++)
+            {
+                curretNode = lists.at(cnt);
+
+                for(int tagNum = 0; tagNum < tags.size() - 1; tagNum++)
+                {
+                    curretNode = findNode(curretNode, tags.at(tagNum + 1));
+
+                    // Not Found node
+                    if(curretNode.isNull())
+                    {
+                        break;
+                    }
+                }
+
+                // Found node
+                if(!curretNode.isNull())
+                {
+                    retNode = curretNode;
+
+                    if(index == foundNodeNum)
+                    {
+                        break;
+                    }
+
+                    foundNodeNum++;
+                }
+            }
+
+        }
+        else if(1 == tags.size())
+        {
+            if(index < lists.size())
+            {
+                retNode = lists.at(index);
+            }
+            else
+            {
+                retNode = lists.at(0);
+            }
+
+            foundNodeNum = lists.size();
+        }
+    }
+
+    return retNode;
+}
+
+
+QList<QDomElement> QtXmlOperation::findAllByNames(QString nodeNames, NodePredicate predicate, void *context, bool skipMatched)
+{
+    QList<QDomElement> ret;
+
+    // "\\W+", use any sequence of non-word characters as the separator
+    QStringList tags = nodeNames.split(QRegExp("\\W+"), QString::SkipEmptyParts);
+
+    if(tags.isEmpty())
+    {
+        return ret;
+    }
+
+    QStringList names;      // Tag names from root down to element
+    QDomElement element = m_doc->documentElement();
+
+    while(!element.isNull())
+    {
+        names.append(element.tagName());
+
+        // The path may start at any depth, compare the last names only
+        bool match = (names.size() >= tags.size());
+        for(int i = 1; i <= tags.size() && match; i++)
+        {
+            match = (names.at(names.size() - i) == tags.at(tags.size() - i));
+        }
+
+        if(match && (NULL == predicate || predicate(element, context)))
+        {
+            ret.append(element);
+        }
+        else
+        {
+            match = false;
+        }
+
+        QDomElement next;
+
+        if(!match || !skipMatched)
+        {
+            next = element.firstChildElement();
+        }
+
+        // Next sibling, or the next sibling of the nearest ancestor which has one
+        while(next.isNull() && !element.isNull())
+        {
+            names.removeLast();
+            next = element.nextSiblingElement();
+
+            if(next.isNull())
+            {
+                element = element.parentNode().toElement();
+            }
+        }
+
+        if(!next.isNull())
+        {
+            element = next;
+        }
+    }
+
+    return ret;
+}
+
+int QtXmlOperation::getNodeCount(QString nodeNames)
+{
+    QDomNode retNode;
+    retNode.clear();
+    int foundNodeNum = 0;
+
+    if(m_indexed && m_doc->documentElement().isNull())
+    {
+        return findIndexNodes(nodeNames).size() / 2;
+    }
+
+    if(!nodeNames.isEmpty())
+    {
+        // "\\W+", use any sequence of non-word characters as the separator
+        QStringList tags = nodeNames.split(QRegExp("\\W+"), QString::SkipEmptyParts);
+        QDomNodeList lists = m_doc->elementsByTagName(tags.at(0));
+        QDomNode curretNode;
+
+        if(tags.size() > 1)
+        {
+            for(int cnt = 0; cnt < lists.size(); cnt++)
+            {
+                curretNode = lists.at(cnt);
+
+                for(int tagNum = 0; tagNum < tags.size() - 1; tagNum++)
+                {
+                    curretNode = findNode(curretNode, tags.at(tagNum + 1));
+
+                    // Not Found node
+                    if(curretNode.isNull())
+                    {
+                        break;
+                    }
+                }
+
+                // Found node
+                if(!curretNode.isNull())
+                {
+                    retNode = curretNode;
+                    foundNodeNum++;
+                }
+            }
+
+        }
+        else if(1 == tags.size())
+        {
+            foundNodeNum = lists.size();
+        }
+    }
+
+    return foundNodeNum;
+}
+
+QtXmlOperation::MemoryUsage QtXmlOperation::getMemoryUsage()
+{
+    MemoryUsage usage = measureDocument(*m_doc);
+
+    QHash<QString, qint64>::const_iterator path;
+    for(path = m_indexPaths.constBegin(); path != m_indexPaths.constEnd(); ++path)
+    {
+        usage.indexBytes += XML_INDEX_ENTRY_BYTES + estimateString(path.key().size());
+    }
+
+    QHash<QString, QVector<qint64> >::const_iterator it;
+    for(it = m_index.constBegin(); it != m_index.constEnd(); ++it)
+    {
+        usage.indexBytes += it.value().capacity() * (qint64)sizeof(qint64);
+    }
+
+    for(it = m_indexQueries.constBegin(); it != m_indexQueries.constEnd(); ++it)
+    {
+        usage.indexBytes += XML_INDEX_ENTRY_BYTES + estimateString(it.key().size())
+                + it.value().capacity() * (qint64)sizeof(qint64);
+    }
+
+    usage.indexBytes += m_indexProlog.capacity();
+
+    usage.totalBytes += usage.indexBytes;
+
+    return usage;
+}
+
+QtXmlOperation::MemoryUsage QtXmlOperation::measureDocument(QDomDocument doc)
+{
+    MemoryUsage usage;
+    usage.elements = 0;
+    usage.attributes = 0;
+    usage.texts = 0;
+    usage.others = 0;
+    usage.stringBytes = 0;
+    usage.indexBytes = 0;
+    usage.totalBytes = 0;
+
+    // Walk the tree in document order without recursion
+    QDomNode node = doc.firstChild();
+
+    while(!node.isNull())
+    {
+        if(node.isElement())
+        {
+            QDomElement element = node.toElement();
+            int nameLength = element.tagName().size();
+
+            usage.elements++;
+            usage.stringBytes += 2 * nameLength;
+            usage.totalBytes += XML_DOM_ELEMENT_BYTES + estimateString(nameLength);
+
+            QDomNamedNodeMap attrs = element.attributes();
+            for(int i = 0; i < attrs.size(); i++)
+            {
+                QDomAttr attr = attrs.item(i).toAttr();
+                int attrNameLength = attr.name().size();
+                int attrValueLength = attr.value().size();
+
+                usage.attributes++;
+                usage.stringBytes += 2 * (attrNameLength + attrValueLength);
+                usage.totalBytes += XML_DOM_ATTR_BYTES + estimateString(attrNameLength) + estimateString(attrValueLength);
+            }
+        }
+        else
+        {
+            // Text and CDATA keep their text as value, others also have a name
+            int nameLength = node.isText() ? 0 : node.nodeName().size();
+            int valueLength = node.nodeValue().size();
+
+            if(node.isText())
+            {
+                usage.texts++;
+            }
+            else
+            {
+                usage.others++;
+            }
+
+            usage.stringBytes += 2 * (nameLength + valueLength);
+            usage.totalBytes += XML_DOM_NODE_BYTES + estimateString(nameLength) + estimateString(valueLength);
+        }
+
+        if(node.hasChildNodes())
+        {
+            node = node.firstChild();
+        }
+        else
+        {
+            while(!node.isNull() && node.nextSibling().isNull())
+            {
+                node = node.parentNode();
+            }
+
+            if(!node.isNull())
+            {
+                node = node.nextSibling();
+            }
+        }
+    }
+
+    return usage;
+}
+
+void QtXmlOperation::setMemoryLimit(qint64 bytes)
+{
+    m_memoryLimit = bytes;
+}
+
+qint64 QtXmlOperation::memoryLimit()
+{
+    return m_memoryLimit;
+}
+
+void QtXmlOperation::setParserType(ParserType type)
+{
+    m_parserType = type;
+}
+
+QtXmlOperation::ParserType QtXmlOperation::parserType()
+{
+    return m_parserType;
+}
+
+void QtXmlOperation::setReadChunkSize(int bytes)
+{
+    m_readChunkSize = qMax(bytes, 0);
+}
+
+int QtXmlOperation::readChunkSize()
+{
+    return m_readChunkSize;
+}
+
+QDomElement QtXmlOperation::getRootElement()
+{
     QDomElement root = m_doc->documentElement();
-    QDomElement currentNode;
-    currentNode.clear();
 
-    if(root.tagName() != nodeName)
+    return root;
+}
+
+QDomNode QtXmlOperation::findNode(QDomNode parentNode, QString childNodeName, bool preciseMatch)
+{
+    QDomNode retNode;
+    retNode.clear();
+
+    if(!parentNode.isNull())
+    {
+        if(preciseMatch)
+        {
+            retNode = parentNode.namedItem(childNodeName);
+        }
+        else
+        {
+            QDomNodeList lists = parentNode.toElement().elementsByTagName(childNodeName);
+
+            if(!lists.isEmpty())
+            {
+                retNode = lists.at(0);
+            }
+        }
+    }
+
+#ifdef ENABLE_DEBUG_TRACE_XML
+    QString str;
+    if(retNode.isNull())
+    {
+         str = QString("findNode() not found parentNode.tagName() =%1 childNodeName = %2")
+                .arg(parentNode.toElement().tagName())
+                .arg(childNodeName);
+    }
+    else
+    {
+        str = QString("findNode() found parentNode.tagName() =%1 childNodeName = %2")
+                .arg(parentNode.toElement().tagName())
+                .arg(childNodeName);
+    }
+
+    qDebug() << str;
+#endif
+
+    return retNode;
+}
+
+bool QtXmlOperation::setWatchEnabled(bool enable, int debounceMs)
+{
+    bool ret = false;
+
+    if(!enable)
+    {
+        if(NULL != m_watcher)
+        {
+            delete m_watcher;
+            m_watcher = NULL;
+        }
+
+        if(NULL != m_reloadTimer)
+        {
+            m_reloadTimer->stop();
+        }
+
+        m_reloadPending = false;
+
+        ret = true;
+    }
+    else if(NULL != m_file)
+    {
+        if(NULL == m_watcher)
+        {
+            m_watcher = new QFileSystemWatcher(this);
+            connect(m_watcher, SIGNAL(fileChanged(QString)), this, SLOT(onWatchedFileChanged(QString)));
+        }
+
+        if(NULL == m_reloadTimer)
+        {
+            m_reloadTimer = new QTimer(this);
+            m_reloadTimer->setSingleShot(true);
+            connect(m_reloadTimer, SIGNAL(timeout()), this, SLOT(onReloadTimeout()));
+        }
+
+        if(NULL == m_reloadWatcher)
+        {
+            m_reloadWatcher = new QFutureWatcher<ReloadResult>(this);
+            connect(m_reloadWatcher, SIGNAL(finished()), this, SLOT(onReloadFinished()));
+        }
+
+        m_reloadTimer->setInterval(debounceMs);
+        updateWatchPath();
+
+        ret = true;
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::isWatchEnabled()
+{
+    return (NULL != m_watcher);
+}
+
+void QtXmlOperation::onWatchedFileChanged(QString fileName)
+{
+    Q_UNUSED(fileName);
+
+    // Editors often replace the file, which drops it from the watcher
+    updateWatchPath();
+
+    // Restart debounce timer, reload once writes have settled
+    m_reloadTimer->start();
+}
+
+void QtXmlOperation::onReloadTimeout()
+{
+    if(!isWatchEnabled() || NULL == m_file)
+    {
+        return;
+    }
+
+    if(m_indexed)
+    {
+        // Indexed mode holds no DOM, refresh the index instead
+        QFileInfo info(m_file->fileName());
+
+        if(info.exists() && (info.size() != m_fileSize || info.lastModified() != m_fileModified))
+        {
+            QString errorStr = "";
+
+            if(reloadIndex(&errorStr))
+            {
+                updateFileStamp();
+
+                emit documentReloaded(m_file->fileName());
+            }
+        }
+
+        return;
+    }
+
+    if(m_inTransaction)
+    {
+        // Do not swap the document under a transaction
+        m_reloadPending = true;
+        return;
+    }
+
+    if(m_reloadRunning)
+    {
+        // Reload again once the running one finished
+        m_reloadPending = true;
+        return;
+    }
+
+    ReloadRequest request;
+    request.fileName = m_file->fileName();
+    request.generation = m_fileGeneration;
+    request.fileSize = m_fileSize;
+    request.fileModified = m_fileModified;
+    request.fileHash = m_fileHash;
+    request.includePaths = m_includePaths;
+    request.memoryLimit = m_memoryLimit;
+    request.parserType = m_parserType;
+    request.chunkSize = m_readChunkSize;
+
+    m_reloadRunning = true;
+    m_reloadWatcher->setFuture(QtConcurrent::run(&QtXmlOperation::reloadFile, request));
+}
+
+void QtXmlOperation::onReloadFinished()
+{
+    ReloadResult result = m_reloadWatcher->result();
+    m_reloadRunning = false;
+
+    if(result.generation != m_fileGeneration || m_indexed)
+    {
+        // Another file was opened meanwhile, the result belongs to the old one
+        delete result.doc;
+    }
+    else if(m_inTransaction)
+    {
+        // Keep the stamp, the reload is started again when the transaction ends
+        delete result.doc;
+        m_reloadPending = true;
+        return;
+    }
+    else if(isWatchEnabled() && NULL != m_file)
+    {
+        m_fileSize = result.fileSize;
+        m_fileModified = result.fileModified;
+        m_fileHash = result.fileHash;
+
+        if(NULL != result.doc)
+        {
+            // Swap in the new document
+            QDomDocument *oldDoc = m_doc;
+            m_doc = result.doc;
+            m_sharedDoc = false;
+            delete oldDoc;
+
+            // Reopen so m_file follows a replaced file
+            reopenFile();
+
+            emit documentReloaded(m_file->fileName());
+        }
+    }
+    else
+    {
+        // Watch stopped meanwhile, drop the result
+        delete result.doc;
+    }
+
+    if(m_reloadPending)
+    {
+        m_reloadPending = false;
+        onReloadTimeout();
+    }
+}
+
+QtXmlOperation::ReloadResult QtXmlOperation::reloadFile(ReloadRequest request)
+{
+    ReloadResult result;
+    result.doc = NULL;
+    result.generation = request.generation;
+    result.fileSize = request.fileSize;
+    result.fileModified = request.fileModified;
+    result.fileHash = request.fileHash;
+
+    QFileInfo info(request.fileName);
+
+    // Size and modification time unchanged, nothing to do
+    if(!info.exists() || (info.size() == request.fileSize && info.lastModified() == request.fileModified))
+    {
+        return result;
+    }
+
+    QFile file(request.fileName);
+
+    if(file.open(QIODevice::ReadOnly))
+    {
+        QByteArray content = file.readAll();
+        file.close();
+
+        result.fileSize = info.size();
+        result.fileModified = info.lastModified();
+
+        QByteArray hash = QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+
+        // Touched but content unchanged
+        if(hash == request.fileHash)
+        {
+            return result;
+        }
+
+        QString errorStr = "";
+        int errorLine = 0;
+        int errorColumn = 0;
+
+        QDomDocument *doc = new QDomDocument;
+        bool parsed = false;
+
+        if(request.includePaths.isEmpty() && 0 == request.memoryLimit && ParserQDom == request.parserType)
+        {
+            parsed = doc->setContent(content, false, &errorStr, &errorLine, &errorColumn);
+        }
+        else
+        {
+            QBuffer buffer(&content);
+            buffer.open(QIODevice::ReadOnly);
+
+            if(request.includePaths.isEmpty())
+            {
+                parsed = parseDocument(&buffer, doc, request.parserType, request.memoryLimit, request.chunkSize,
+                                       &errorStr, &errorLine, &errorColumn);
+            }
+            else
+            {
+                parsed = parseFiltered(&buffer, doc, request.includePaths, request.memoryLimit,
+                                       &errorStr, &errorLine, &errorColumn);
+            }
+        }
+
+        if(parsed)
+        {
+            result.doc = doc;
+            result.fileHash = hash;
+        }
+        else
+        {
+            // Probably caught in the middle of a write, keep the old document
+            // and old stamp so the next change triggers another reload
+            qDebug() << "Error: Reload parse error at line " << errorLine << ", "
+                     << "column " << errorColumn << ": "
+                     << qPrintable(errorStr);
+
+            result.fileSize = request.fileSize;
+            result.fileModified = request.fileModified;
+            delete doc;
+        }
+    }
+
+    return result;
+}
+
+void QtXmlOperation::onAsyncFinished()
+{
+    AsyncResult result = m_asyncWatcher->result();
+    AsyncOperation op = m_asyncQueue.takeFirst();
+    m_asyncRunning = false;
+
+    if(op.save)
+    {
+        // Document not changed during the save, stop copy on write
+        // unless another pending save still shares it
+        if(*m_doc == op.doc)
+        {
+            bool pending = false;
+
+            for(int i = 0; i < m_asyncQueue.size(); i++)
+            {
+                if(m_asyncQueue.at(i).save && m_asyncQueue.at(i).doc == op.doc)
+                {
+                    pending = true;
+                    break;
+                }
+            }
+
+            if(!pending)
+            {
+                m_sharedDoc = op.wasShared;
+            }
+        }
+    }
+    else if(NULL != result.doc)
+    {
+        // Same as openDocument, then swap in the parsed document
+        openFile(op.fileName);
+        m_includePaths.clear();
+        clearIndex();
+
+        QDomDocument *oldDoc = m_doc;
+        m_doc = result.doc;
+        m_sharedDoc = false;
+        delete oldDoc;
+
+        updateFileStamp();
+        updateWatchPath();
+    }
+
+    op.promise.reportResult(result.ok);
+    op.promise.reportFinished();
+
+    if(!result.ok)
+    {
+        emit failed(op.fileName, result.errorStr);
+    }
+    else if(op.save)
+    {
+        emit saved(op.fileName);
+    }
+    else
+    {
+        emit loaded(op.fileName);
+    }
+
+    startAsyncOperation();
+}
+
+void QtXmlOperation::startAsyncOperation()
+{
+    if(m_asyncRunning || m_asyncQueue.isEmpty())
+    {
+        return;
+    }
+
+    if(NULL == m_asyncWatcher)
+    {
+        m_asyncWatcher = new QFutureWatcher<AsyncResult>(this);
+        connect(m_asyncWatcher, SIGNAL(finished()), this, SLOT(onAsyncFinished()));
+    }
+
+    const AsyncOperation &op = m_asyncQueue.first();
+    m_asyncRunning = true;
+
+    if(op.save)
+    {
+        m_asyncWatcher->setFuture(QtConcurrent::run(&QtXmlOperation::saveFile, op.fileName, op.doc));
+    }
+    else
+    {
+        m_asyncWatcher->setFuture(QtConcurrent::run(&QtXmlOperation::loadFile, op.fileName, m_memoryLimit, m_parserType,
+                                                       m_readChunkSize));
+    }
+}
+
+bool QtXmlOperation::isOpenPending()
+{
+    bool ret = false;
+
+    for(int i = 0; i < m_asyncQueue.size(); i++)
+    {
+        if(!m_asyncQueue.at(i).save)
+        {
+            ret = true;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+QtXmlOperation::AsyncResult QtXmlOperation::loadFile(QString fileName, qint64 memoryLimit, ParserType parserType, int chunkSize)
+{
+    AsyncResult result;
+    result.doc = NULL;
+    result.ok = false;
+
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        result.errorStr = file.errorString();
+        return result;
+    }
+
+    QString errorStr = "";
+    int errorLine = 0;
+    int errorColumn = 0;
+
+    QDomDocument *doc = new QDomDocument;
+
+    if(parseDocument(&file, doc, parserType, memoryLimit, chunkSize, &errorStr, &errorLine, &errorColumn))
+    {
+        result.doc = doc;
+        result.ok = true;
+    }
+    else
+    {
+        result.errorStr = QString("Parse error at line %1, column %2: %3")
+                .arg(errorLine)
+                .arg(errorColumn)
+                .arg(errorStr);
+        delete doc;
+    }
+
+    return result;
+}
+
+QtXmlOperation::AsyncResult QtXmlOperation::saveFile(QString fileName, QDomDocument doc)
+{
+    AsyncResult result;
+    result.doc = NULL;
+    result.ok = saveDocument(doc, fileName, &result.errorStr);
+
+    return result;
+}
+
+bool QtXmlOperation::saveDocument(QDomDocument doc, QString fileName, QString *errorStr)
+{
+    bool ret = false;
+
+    QFile file(fileName);
+
+    // If file not exist create one
+    if (!file.exists())
+    {
+        file.open(QIODevice::WriteOnly);
+        file.close();
+    }
+
+    // Overwrite the file
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        QTextStream stream(&file);
+        stream.setCodec("UTF-8");
+        doc.save(stream, 4);
+        file.close();
+
+        ret = true;
+    }
+    else if(NULL != errorStr)
+    {
+        *errorStr = file.errorString();
+    }
+
+    return ret;
+}
+
+void QtXmlOperation::updateFileStamp()
+{
+    m_fileSize = -1;
+    m_fileModified = QDateTime();
+    m_fileHash.clear();
+
+    if(NULL != m_file)
+    {
+        QFileInfo info(*m_file);
+
+        if(info.exists())
+        {
+            m_fileSize = info.size();
+            m_fileModified = info.lastModified();
+        }
+    }
+}
+
+void QtXmlOperation::updateWatchPath()
+{
+    if(NULL == m_watcher)
+    {
+        return;
+    }
+
+    if(!m_watcher->files().isEmpty())
+    {
+        m_watcher->removePaths(m_watcher->files());
+    }
+
+    if(NULL != m_file && m_file->exists())
+    {
+        m_watcher->addPath(m_file->fileName());
+    }
+}
+
+bool QtXmlOperation::parseFiltered(QIODevice *device, QDomDocument *doc, QStringList includePaths, qint64 memoryLimit,
+                                   QString *errorStr, int *errorLine, int *errorColumn, bool *unsupported)
+{
+    bool ret = false;
+
+    // "\\W+", use any sequence of non-word characters as the separator
+    QList<QStringList> paths;
+    for(int i = 0; i < includePaths.size(); i++)
+    {
+        QStringList tags = includePaths.at(i).split(QRegExp("\\W+"), QString::SkipEmptyParts);
+
+        if(!tags.isEmpty())
+        {
+            paths.append(tags);
+        }
+    }
+
+    QXmlStreamReader reader(device);
+    reader.setNamespaceProcessing(false);
+
+    QStringList tagStack;       // Names of the open elements
+    QList<QXmlStreamAttributes> attrStack;  // Attributes of the open elements, for late creation
+    QDomNode currentNode = *doc;
+    int createdDepth = 0;       // Open elements already created in doc, always the outermost ones
+    int keepDepth = 0;          // Depth below which everything is kept, 0: not inside a kept subtree
+    bool keepAll = paths.isEmpty();
+    qint64 usage = 0;           // Estimated memory of the nodes created so far
+
+    while(!reader.atEnd())
+    {
+        QXmlStreamReader::TokenType token = reader.readNext();
+
+        if(QXmlStreamReader::StartDocument == token)
+        {
+            if(!reader.documentVersion().isEmpty())
+            {
+                QString data = QString("version=\'%1\'").arg(reader.documentVersion().toString());
+
+                if(!reader.documentEncoding().isEmpty())
+                {
+                    data.append(QString(" encoding=\'%1\'").arg(reader.documentEncoding().toString()));
+                }
+
+                // Only "yes" is visible through the reader, like setContent write it back
+                if(reader.isStandaloneDocument())
+                {
+                    data.append(" standalone=\'yes\'");
+                }
+
+                doc->appendChild(doc->createProcessingInstruction("xml", data));
+            }
+        }
+        else if(QXmlStreamReader::StartElement == token)
+        {
+            tagStack.append(reader.qualifiedName().toString());
+            attrStack.append(reader.attributes());
+
+            bool keep = (keepAll || keepDepth > 0);
+
+            // Like findNodeByNames the first tag may match at any depth,
+            // the element is kept when the open elements end with a path
+            for(int i = 0; i < paths.size() && !keep; i++)
+            {
+                const QStringList &tags = paths.at(i);
+                int offset = tagStack.size() - tags.size();
+
+                bool match = (offset >= 0);
+                for(int j = 0; j < tags.size() && match; j++)
+                {
+                    match = (tags.at(j) == tagStack.at(offset + j));
+                }
+
+                if(match)
+                {
+                    keep = true;
+                    keepDepth = tagStack.size();
+                }
+            }
+
+            if(keep)
+            {
+                // Create the element and its ancestors not created yet, ancestors without their text
+                for(; createdDepth < tagStack.size(); createdDepth++)
+                {
+                    QDomElement element = doc->createElement(tagStack.at(createdDepth));
+                    usage += XML_DOM_ELEMENT_BYTES + estimateString(tagStack.at(createdDepth).size());
+
+                    const QXmlStreamAttributes &attrs = attrStack.at(createdDepth);
+                    for(int i = 0; i < attrs.size(); i++)
+                    {
+                        element.setAttribute(attrs.at(i).qualifiedName().toString(), attrs.at(i).value().toString());
+                        usage += XML_DOM_ATTR_BYTES + estimateString(attrs.at(i).qualifiedName().size())
+                                + estimateString(attrs.at(i).value().size());
+                    }
+
+                    currentNode.appendChild(element);
+                    currentNode = element;
+                }
+            }
+        }
+        else if(QXmlStreamReader::EndElement == token)
+        {
+            if(keepDepth == tagStack.size())
+            {
+                keepDepth = 0;
+            }
+
+            if(createdDepth == tagStack.size())
+            {
+                createdDepth--;
+                currentNode = currentNode.parentNode();
+            }
+
+            tagStack.removeLast();
+            attrStack.removeLast();
+        }
+        else if(NULL != unsupported
+                && (QXmlStreamReader::DTD == token || QXmlStreamReader::EntityReference == token))
+        {
+            // QDom keeps the DOCTYPE and expands its entities, leave those to setContent
+            *unsupported = true;
+            reader.raiseError("Document type declarations are not supported");
+        }
+        else if(keepAll || keepDepth > 0)
+        {
+            if(QXmlStreamReader::Characters == token)
+            {
+                if(reader.isCDATA())
+                {
+                    currentNode.appendChild(doc->createCDATASection(reader.text().toString()));
+                    usage += XML_DOM_NODE_BYTES + estimateString(reader.text().size());
+                }
+                else if(!reader.isWhitespace())
+                {
+                    currentNode.appendChild(doc->createTextNode(reader.text().toString()));
+                    usage += XML_DOM_NODE_BYTES + estimateString(reader.text().size());
+                }
+            }
+            else if(QXmlStreamReader::Comment == token)
+            {
+                currentNode.appendChild(doc->createComment(reader.text().toString()));
+                usage += XML_DOM_NODE_BYTES + estimateString(reader.text().size());
+            }
+            else if(QXmlStreamReader::ProcessingInstruction == token)
+            {
+                currentNode.appendChild(doc->createProcessingInstruction(reader.processingInstructionTarget().toString(),
+                                                                         reader.processingInstructionData().toString()));
+                usage += XML_DOM_NODE_BYTES + estimateString(reader.processingInstructionTarget().size())
+                        + estimateString(reader.processingInstructionData().size());
+            }
+        }
+
+        // Fail fast instead of building the rest of an oversized document
+        if(memoryLimit > 0 && usage > memoryLimit)
+        {
+            reader.raiseError(QString("Memory limit of %1 bytes exceeded").arg(memoryLimit));
+        }
+    }
+
+    // Nothing matched, fail instead of returning a document without root
+    if(!reader.hasError() && doc->documentElement().isNull())
+    {
+        reader.raiseError("No element matches the include paths");
+    }
+
+    if(reader.hasError())
+    {
+        if(NULL != errorStr)
+        {
+            *errorStr = reader.errorString();
+        }
+
+        if(NULL != errorLine)
+        {
+            *errorLine = (int)reader.lineNumber();
+        }
+
+        if(NULL != errorColumn)
+        {
+            *errorColumn = (int)reader.columnNumber();
+        }
+
+        doc->clear();
+    }
+    else
+    {
+        ret = true;
+    }
+
+    return ret;
+}
+
+bool QtXmlOperation::parseDocument(QIODevice *device, QDomDocument *doc, ParserType parserType, qint64 memoryLimit,
+                                   int chunkSize, QString *errorStr, int *errorLine, int *errorColumn)
+{
+    if(ParserFast == parserType && isUtf8Document(device))
+    {
+        qint64 start = device->pos();
+        bool unsupported = false;
+
+        if(parseFast(device, doc, memoryLimit, chunkSize, &unsupported, errorStr, errorLine, errorColumn))
+        {
+            return true;
+        }
+
+        // A DOCTYPE may declare entities and non-ASCII names have their own
+        // rules, parse those again from the beginning
+        if(!unsupported || !device->seek(start))
+        {
+            return false;
+        }
+    }
+
+    if(memoryLimit > 0)
+    {
+        qint64 start = device->pos();
+        bool unsupported = false;
+
+        // Build the DOM from the stream so the limit is checked while parsing
+        if(parseFiltered(device, doc, QStringList(), memoryLimit, errorStr, errorLine, errorColumn, &unsupported))
+        {
+            return true;
+        }
+
+        // Same tree as without a limit: a DOCTYPE goes through setContent,
+        // the limit is checked once the document is built
+        if(!unsupported || !device->seek(start))
+        {
+            return false;
+        }
+
+        if(!doc->setContent(device, false, errorStr, errorLine, errorColumn))
+        {
+            return false;
+        }
+
+        if(measureDocument(*doc).totalBytes > memoryLimit)
+        {
+            if(NULL != errorStr)
+            {
+                *errorStr = QString("Memory limit of %1 bytes exceeded").arg(memoryLimit);
+            }
+
+            if(NULL != errorLine)
+            {
+                *errorLine = 0;
+            }
+
+            if(NULL != errorColumn)
+            {
+                *errorColumn = 0;
+            }
+
+            doc->clear();
+            return false;
+        }
+
+        return true;
+    }
+
+    return doc->setContent(device, false, errorStr, errorLine, errorColumn);
+}
+
+bool QtXmlOperation::parseFast(QIODevice *device, QDomDocument *doc, qint64 memoryLimit, int chunkSize, bool *unsupported,
+                               QString *errorStr, int *errorLine, int *errorColumn)
+{
+    *unsupported = false;
+
+    // Skip the UTF-8 byte order mark
+    if(device->peek(3) == "\xEF\xBB\xBF")
+    {
+        device->read(3);
+    }
+
+    qint64 start = device->pos();
+
+    QtXmlScanner scanner(device, chunkSize);
+    scanner.setUtf8Check(true);
+
+    QString error = "";
+    qint64 errorOffset = -1;
+
+    QList<QByteArray> tagStack;     // Names of the open elements
+    QDomNode currentNode = *doc;
+    bool rootFound = false;
+    QByteArray text;                // Character data, may come in several tokens
+    qint64 textOffset = 0;
+    qint64 usage = 0;               // Estimated memory of the nodes created so far
+
+    for(;;)
+    {
+        QtXmlScanner::TokenType token = scanner.readNext();
+
+        if(QtXmlScanner::Text == token)
+        {
+            if(text.isEmpty())
+            {
+                textOffset = scanner.tokenBegin();
+            }
+
+            QByteArray data = scanner.tokenData();
+            text.append(data.constData(), data.size());
+            continue;
+        }
+
+        // Whitespace only text is dropped like QDomDocument::setContent does
+        if(!text.isEmpty())
+        {
+            int ws = QtXmlSimd::skipWhitespace(text.constData(), text.size());
+
+            if(ws < text.size())
+            {
+                QString value;
+
+                if(tagStack.isEmpty())
+                {
+                    error = "Text outside of the root element";
+                    errorOffset = textOffset + ws;
+                    break;
+                }
+
+                int cdataEnd = text.indexOf("]]>");
+
+                if(cdataEnd >= 0)
+                {
+                    error = "\"]]>\" in character data";
+                    errorOffset = textOffset + cdataEnd;
+                    break;
+                }
+
+                if(!decodeXmlText(text.constData(), text.size(), false, &value))
+                {
+                    error = "Invalid entity reference";
+                    errorOffset = textOffset;
+                    break;
+                }
+
+                currentNode.appendChild(doc->createTextNode(value));
+                usage += XML_DOM_NODE_BYTES + estimateString(value.size());
+            }
+
+            text.clear();
+        }
+
+        if(QtXmlScanner::EndOfFile == token)
+        {
+            if(!tagStack.isEmpty())
+            {
+                error = QString("Unexpected end of file, element %1 not closed").arg(QString::fromUtf8(tagStack.last().constData(), tagStack.last().size()));
+                errorOffset = scanner.tokenBegin();
+            }
+            else if(!rootFound)
+            {
+                error = "No root element";
+                errorOffset = scanner.tokenBegin();
+            }
+            break;
+        }
+
+        if(QtXmlScanner::Error == token)
+        {
+            error = scanner.errorString();
+            errorOffset = scanner.tokenBegin();
+            break;
+        }
+
+        QByteArray data = scanner.tokenData();
+
+        if(QtXmlScanner::StartElement == token || QtXmlScanner::EmptyElement == token)
+        {
+            if(tagStack.isEmpty() && rootFound)
+            {
+                error = "Extra content after the root element";
+                errorOffset = scanner.tokenBegin();
+                break;
+            }
+
+            QByteArray name = scanner.name();
+            int nameCheck = checkXmlName(name.constData(), name.size());
+
+            if(nameCheck <= 0)
+            {
+                *unsupported = (nameCheck < 0);
+                error = QString("Invalid element name %1").arg(QString::fromUtf8(name.constData(), name.size()));
+                errorOffset = scanner.tokenBegin();
+                break;
+            }
+
+            QDomElement element = doc->createElement(QString::fromUtf8(name.constData(), name.size()));
+            usage += XML_DOM_ELEMENT_BYTES + estimateString(name.size());
+
+            int attrBegin = 1 + name.size();
+            int attrEnd = data.size() - ((QtXmlScanner::EmptyElement == token) ? 2 : 1);
+
+            if(!parseXmlAttributes(data.constData() + attrBegin, attrEnd - attrBegin, &element, &usage, unsupported))
+            {
+                error = QString("Invalid attribute in element %1").arg(QString::fromUtf8(name.constData(), name.size()));
+                errorOffset = scanner.tokenBegin();
+                break;
+            }
+
+            currentNode.appendChild(element);
+            rootFound = true;
+
+            if(QtXmlScanner::StartElement == token)
+            {
+                tagStack.append(name);
+                currentNode = element;
+            }
+        }
+        else if(QtXmlScanner::EndElement == token)
+        {
+            QByteArray name = scanner.name();
+            int rest = 2 + name.size();
+
+            if(tagStack.isEmpty() || tagStack.last() != name
+               || QtXmlSimd::skipWhitespace(data.constData() + rest, data.size() - rest - 1) != data.size() - rest - 1)
+            {
+                error = QString("Unexpected end tag %1").arg(QString::fromUtf8(name.constData(), name.size()));
+                errorOffset = scanner.tokenBegin();
+                break;
+            }
+
+            tagStack.removeLast();
+            currentNode = currentNode.parentNode();
+        }
+        else if(QtXmlScanner::CData == token)
+        {
+            if(tagStack.isEmpty())
+            {
+                error = "CDATA outside of the root element";
+                errorOffset = scanner.tokenBegin();
+                break;
+            }
+
+            QString value = QString::fromUtf8(data.constData() + 9, data.size() - 12);
+
+            if(value.contains('\r'))
+            {
+                value.replace("\r\n", "\n");
+                value.replace('\r', '\n');
+            }
+
+            currentNode.appendChild(doc->createCDATASection(value));
+            usage += XML_DOM_NODE_BYTES + estimateString(value.size());
+        }
+        else if(QtXmlScanner::Comment == token)
+        {
+            QByteArray content = QByteArray::fromRawData(data.constData() + 4, data.size() - 7);
+
+            // "--" must not occur in a comment, "--->" neither
+            if(content.contains("--") || content.endsWith('-'))
+            {
+                error = "\"--\" in comment";
+                errorOffset = scanner.tokenBegin();
+                break;
+            }
+
+            QString value = QString::fromUtf8(content.constData(), content.size());
+
+            currentNode.appendChild(doc->createComment(value));
+            usage += XML_DOM_NODE_BYTES + estimateString(value.size());
+        }
+        else if(QtXmlScanner::ProcessingInstruction == token)
+        {
+            const char *content = data.constData() + 2;
+            int size = data.size() - 4;
+
+            int targetLen = QtXmlSimd::findFirstOf(content, size, " \t\r\n");
+
+            if(targetLen < 0)
+            {
+                targetLen = size;
+            }
+
+            int dataBegin = targetLen + QtXmlSimd::skipWhitespace(content + targetLen, size - targetLen);
+
+            int nameCheck = checkXmlName(content, targetLen);
+
+            if(nameCheck <= 0)
+            {
+                *unsupported = (nameCheck < 0);
+                error = "Invalid processing instruction target";
+                errorOffset = scanner.tokenBegin();
+                break;
+            }
+
+            QString target = QString::fromUtf8(content, targetLen);
+            QString value = QString::fromUtf8(content + dataBegin, size - dataBegin);
+
+            if(0 == target.compare("xml", Qt::CaseInsensitive))
+            {
+                // The XML declaration is only allowed at the very beginning,
+                // other targets starting with "xml" in any case are reserved
+                if("xml" != target || scanner.tokenBegin() != start)
+                {
+                    error = "XML declaration not at the start of the document";
+                    errorOffset = scanner.tokenBegin();
+                    break;
+                }
+
+                if(!parseXmlDeclaration(content + dataBegin, size - dataBegin, &value))
+                {
+                    error = "Invalid XML declaration";
+                    errorOffset = scanner.tokenBegin();
+                    break;
+                }
+            }
+
+            currentNode.appendChild(doc->createProcessingInstruction(target, value));
+            usage += XML_DOM_NODE_BYTES + estimateString(target.size()) + estimateString(value.size());
+        }
+        else if(QtXmlScanner::Declaration == token)
+        {
+            if(data.startsWith("<!DOCTYPE"))
+            {
+                // Entities and defaults of the DTD are left to QDomDocument
+                *unsupported = true;
+                error = "DOCTYPE is not supported by the fast parser";
+            }
+            else
+            {
+                error = "Unexpected declaration";
+            }
+
+            errorOffset = scanner.tokenBegin();
+            break;
+        }
+
+        // Fail fast instead of building the rest of an oversized document
+        if(memoryLimit > 0 && usage > memoryLimit)
+        {
+            error = QString("Memory limit of %1 bytes exceeded").arg(memoryLimit);
+            errorOffset = scanner.tokenEnd();
+            break;
+        }
+    }
+
+    if(!error.isEmpty())
+    {
+        if(NULL != errorStr)
+        {
+            *errorStr = error;
+        }
+
+        if(!*unsupported)
+        {
+            locateXmlError(device, start, errorOffset, errorLine, errorColumn);
+        }
+
+        doc->clear();
+
+        return false;
+    }
+
+    return true;
+}
+
+bool QtXmlOperation::isUtf8Document(QIODevice *device)
+{
+    QByteArray head = device->peek(256);
+
+    if(head.startsWith("\xEF\xBB\xBF"))
+    {
+        return true;
+    }
+
+    // UTF-16 or UTF-32, with or without byte order mark
+    if(head.size() >= 2 && (0 == head.at(0) || 0 == head.at(1) || head.startsWith("\xFE\xFF") || head.startsWith("\xFF\xFE")))
+    {
+        return false;
+    }
+
+    if(head.startsWith("<?xml"))
+    {
+        int end = head.indexOf("?>");
+        QString declaration = QString::fromLatin1(head.left((end >= 0) ? end : head.size()));
+        QRegExp encoding("encoding\\s*=\\s*[\"']([^\"']*)[\"']");
+
+        if(encoding.indexIn(declaration) >= 0)
+        {
+            QString name = encoding.cap(1).toLower();
+
+            return ("utf-8" == name || "utf8" == name || "us-ascii" == name);
+        }
+    }
+
+    return true;
+}
+
+bool QtXmlOperation::loadIndex(QString fileName, QHash<QString, qint64> *paths, QHash<QString, QVector<qint64> > *index,
+                               QByteArray *prolog, QString *errorStr)
+{
+    QFileInfo info(fileName);
+    QFile indexFile(fileName + ".idx");
+
+    paths->clear();
+    index->clear();
+    prolog->clear();
+
+    // Reuse the index file while the xml file is unchanged, only its path directory is read
+    if(indexFile.open(QIODevice::ReadOnly))
+    {
+        QDataStream in(&indexFile);
+        in.setVersion(QDataStream::Qt_4_6);
+
+        quint32 magic = 0;
+        quint32 version = 0;
+        qint64 fileSize = -1;
+        QDateTime fileModified;
+        qint64 directory = -1;
+
+        in >> magic >> version >> fileSize >> fileModified >> *prolog >> directory;
+
+        if(XML_INDEX_MAGIC == magic && XML_INDEX_VERSION == version
+                && info.size() == fileSize && info.lastModified() == fileModified
+                && QDataStream::Ok == in.status() && indexFile.seek(directory))
+        {
+            in >> *paths;
+
+            if(QDataStream::Ok == in.status())
+            {
+                return true;
+            }
+        }
+
+        indexFile.close();
+        paths->clear();
+        prolog->clear();
+    }
+
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        *errorStr = file.errorString();
+        return false;
+    }
+
+    if(!scanIndex(&file, index, prolog, errorStr))
+    {
+        index->clear();
+        prolog->clear();
+        return false;
+    }
+
+    // The scanned offsets stay in RAM, the index file serves later opens
+    QHash<QString, QVector<qint64> >::const_iterator it;
+    for(it = index->constBegin(); it != index->constEnd(); ++it)
+    {
+        paths->insert(it.key(), -1);
+    }
+
+    if(indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        QDataStream out(&indexFile);
+        out.setVersion(QDataStream::Qt_4_6);
+
+        // Magic is written last, an interrupted write leaves no valid index file
+        out << (quint32)0 << (quint32)XML_INDEX_VERSION << info.size() << info.lastModified() << *prolog;
+
+        qint64 directoryField = indexFile.pos();
+        out << (qint64)0;
+
+        // Offsets of every path, then the directory of their positions
+        QHash<QString, qint64> positions;
+        for(it = index->constBegin(); it != index->constEnd(); ++it)
+        {
+            positions.insert(it.key(), indexFile.pos());
+            out << it.value();
+        }
+
+        qint64 directory = indexFile.pos();
+        out << positions;
+
+        if(QFile::NoError == indexFile.error() && indexFile.seek(directoryField))
+        {
+            out << directory;
+
+            if(indexFile.seek(0))
+            {
+                out << (quint32)XML_INDEX_MAGIC;
+            }
+        }
+
+        indexFile.close();
+    }
+
+    return true;
+}
+
+bool QtXmlOperation::scanIndex(QIODevice *device, QHash<QString, QVector<qint64> > *index, QByteArray *prolog,
+                               QString *errorStr)
+{
+    QtXmlScanner scanner(device);
+    QList<QByteArray> nameStack;
+    QStringList pathStack;
+    QVector<qint64> beginStack;
+    qint64 rootBegin = -1;
+
+    for(;;)
+    {
+        QtXmlScanner::TokenType type = scanner.readNext();
+
+        if(QtXmlScanner::StartElement == type || QtXmlScanner::EmptyElement == type)
+        {
+            QString name = QString::fromUtf8(scanner.name());
+            QString path = pathStack.isEmpty() ? name : (pathStack.last() + "/" + name);
+
+            if(rootBegin < 0)
+            {
+                rootBegin = scanner.tokenBegin();
+            }
+
+            if(QtXmlScanner::EmptyElement == type)
+            {
+                QVector<qint64> &ranges = (*index)[path];
+                ranges.append(scanner.tokenBegin());
+                ranges.append(scanner.tokenEnd());
+            }
+            else
+            {
+                nameStack.append(scanner.name());
+                pathStack.append(path);
+                beginStack.append(scanner.tokenBegin());
+            }
+        }
+        else if(QtXmlScanner::EndElement == type)
+        {
+            if(nameStack.isEmpty() || nameStack.last() != scanner.name())
+            {
+                *errorStr = QString("Unexpected end tag </%1> at offset %2")
+                        .arg(QString::fromUtf8(scanner.name()))
+                        .arg(scanner.tokenBegin());
+                return false;
+            }
+
+            QVector<qint64> &ranges = (*index)[pathStack.last()];
+            ranges.append(beginStack.last());
+            ranges.append(scanner.tokenEnd());
+
+            nameStack.removeLast();
+            pathStack.removeLast();
+            beginStack.remove(beginStack.size() - 1);
+        }
+        else if(QtXmlScanner::EndOfFile == type)
+        {
+            if(!nameStack.isEmpty())
+            {
+                *errorStr = QString("Unexpected end of file, <%1> is not closed")
+                        .arg(QString::fromUtf8(nameStack.last()));
+                return false;
+            }
+
+            break;
+        }
+        else if(QtXmlScanner::Error == type)
+        {
+            *errorStr = scanner.errorString();
+            return false;
+        }
+    }
+
+    // Byte order mark, declaration and DOCTYPE, an element parsed alone needs them
+    // for its encoding and entities
+    if(rootBegin > 0)
+    {
+        if(!device->seek(0))
+        {
+            *errorStr = device->errorString();
+            return false;
+        }
+
+        *prolog = device->read(rootBegin);
+    }
+
+    return true;
+}
+
+bool QtXmlOperation::reloadIndex(QString *errorStr)
+{
+    bool ret = false;
+
+    m_indexPaths.clear();
+    m_index.clear();
+    m_indexQueries.clear();
+    m_indexProlog.clear();
+
+    if(NULL != m_file)
+    {
+        ret = loadIndex(m_file->fileName(), &m_indexPaths, &m_index, &m_indexProlog, errorStr);
+    }
+
+    return ret;
+}
+
+void QtXmlOperation::clearIndex()
+{
+    m_indexPaths.clear();
+    m_index.clear();
+    m_indexQueries.clear();
+    m_indexProlog.clear();
+    m_indexed = false;
+}
+
+QVector<qint64> QtXmlOperation::indexRanges(QString path)
+{
+    QVector<qint64> ret;
+
+    if(m_index.contains(path))
+    {
+        return m_index.value(path);
+    }
+
+    qint64 position = m_indexPaths.value(path, -1);
+
+    if(position < 0 || NULL == m_file)
+    {
+        return ret;
+    }
+
+    QFile indexFile(m_file->fileName() + ".idx");
+    bool loaded = false;
+
+    if(indexFile.open(QIODevice::ReadOnly))
+    {
+        QDataStream in(&indexFile);
+        in.setVersion(QDataStream::Qt_4_6);
+
+        quint32 magic = 0;
+        quint32 version = 0;
+        qint64 fileSize = -1;
+        QDateTime fileModified;
+
+        in >> magic >> version >> fileSize >> fileModified;
+
+        // Another instance may have rewritten the index file for a changed xml file
+        if(XML_INDEX_MAGIC == magic && XML_INDEX_VERSION == version
+                && m_fileSize == fileSize && m_fileModified == fileModified && indexFile.seek(position))
+        {
+            in >> ret;
+            loaded = (QDataStream::Ok == in.status());
+        }
+    }
+
+    if(loaded)
+    {
+        m_index.insert(path, ret);
+    }
+    else
+    {
+        qDebug() << "Error: Index file of " << m_file->fileName() << " changed, rebuilding the index";
+
+        // Forget the stamp so the next lookup rebuilds the index
+        ret.clear();
+        m_fileSize = -1;
+        m_fileModified = QDateTime();
+    }
+
+    return ret;
+}
+
+QVector<qint64> QtXmlOperation::findIndexRanges(QString nodeNames)
+{
+    QVector<qint64> ret;
+
+    if(!refreshIndex())
+    {
+        return ret;
+    }
+
+    // "\\W+", use any sequence of non-word characters as the separator
+    QStringList tags = nodeNames.split(QRegExp("\\W+"), QString::SkipEmptyParts);
+
+    if(tags.isEmpty())
+    {
+        return ret;
+    }
+
+    // "*": every match, "=": findIndexNodes
+    QString path = tags.join("/");
+    QString key = "*" + path;
+
+    if(m_indexQueries.contains(key))
     {
-        currentNode = findNodeByNames(nodeName, nodeIndex).toElement();
+        return m_indexQueries.value(key);
+    }
 
-        if(!currentNode.isNull())
+    QString suffix = "/" + path;
+    QList<QVector<qint64> > matches;
+
+    QHash<QString, qint64>::const_iterator it;
+    for(it = m_indexPaths.constBegin(); it != m_indexPaths.constEnd(); ++it)
+    {
+        if(it.key() == path || it.key().endsWith(suffix))
         {
-            QDomElement parentNode = currentNode.parentNode().toElement();
+            matches.append(indexRanges(it.key()));
+        }
+    }
 
-            if(!parentNode.isNull())
-            {
-                parentNode.removeChild(currentNode);
-            }
-            else
+    if(1 == matches.size())
+    {
+        ret = matches.first();
+    }
+    else if(matches.size() > 1)
+    {
+        // Merge several full paths into document order
+        QVector<QPair<qint64, qint64> > pairs;
+
+        for(int i = 0; i < matches.size(); i++)
+        {
+            for(int j = 0; j + 1 < matches.at(i).size(); j += 2)
             {
-                m_doc->removeChild(root);
+                pairs.append(qMakePair(matches.at(i).at(j), matches.at(i).at(j + 1)));
             }
+        }
 
-            ret = true;
+        qSort(pairs);
+
+        ret.reserve(pairs.size() * 2);
+        for(int i = 0; i < pairs.size(); i++)
+        {
+            ret.append(pairs.at(i).first);
+            ret.append(pairs.at(i).second);
         }
     }
-    else
-    {
-        m_doc->removeChild(root);
-        ret = true;
-    }
+
+    m_indexQueries.insert(key, ret);
 
     return ret;
 }
 
-bool QtXmlOperation::replaceNode(QString parentNodeName, QString nodeName, QString nodeText, QStringList attrNames, QStringList attrs, int parentIndex)
+QVector<qint64> QtXmlOperation::findIndexNodes(QString nodeNames)
 {
-    bool ret = false;
+    QVector<qint64> ret;
 
-    if(deleteNode(nodeName, parentIndex))
+    if(!refreshIndex())
     {
-        ret = insertNode(parentNodeName, nodeName, nodeText, attrNames, attrs, parentIndex);
+        return ret;
     }
 
-    return ret;
-}
+    // "\\W+", use any sequence of non-word characters as the separator
+    QStringList tags = nodeNames.split(QRegExp("\\W+"), QString::SkipEmptyParts);
 
-QDomNode QtXmlOperation::findNodeByNames(QString nodeNames, int index)
-{
-    QDomNode retNode;
-    retNode.clear();
-    int foundNodeNum = 0;
+    if(tags.isEmpty())
+    {
+        return ret;
+    }
 
-    if(!nodeNames.isEmpty())
+    QString key = "=" + tags.join("/");
+
+    if(m_indexQueries.contains(key))
     {
-        // "\\W+", use any sequence of non-word characters as the separator
-        QStringList tags = nodeNames.split(QRegExp("\\W+"), QString::SkipEmptyParts);
-        QDomNodeList lists = m_doc->elementsByTagName(tags.at(0));
-        QDomNode curretNode;
+        return m_indexQueries.value(key);
+    }
 
-        //qDebug() << __FUNCTION__ << "(): " << "tags = " << tags;
+    // Begin of the first tag element, then begin/end of the found element
+    QVector<QPair<qint64, QPair<qint64, qint64> > > found;
+    QString suffix = "/" + tags.at(0);
 
-        if(tags.size() > 1)
+    QHash<QString, qint64>::const_iterator it;
+    for(it = m_indexPaths.constBegin(); it != m_indexPaths.constEnd(); ++it)
+    {
+        // Like elementsByTagName the first tag matches at any depth
+        if(it.key() != tags.at(0) && !it.key().endsWith(suffix))
         {
-            for(int cnt = 0; cnt < lists.size(); cnt++)
+            continue;
+        }
+
+        QVector<qint64> ranges = indexRanges(it.key());
+        QList<QVector<qint64> > children;
+        QString path = it.key();
+
+        for(int tagNum = 1; tagNum < tags.size(); tagNum++)
+        {
+            path += "/" + tags.at(tagNum);
+            children.append(indexRanges(path));
+        }
+
+        for(int i = 0; i + 1 < ranges.size(); i += 2)
+        {
+            qint64 begin = ranges.at(i);
+            qint64 end = ranges.at(i + 1);
+            bool match = true;
+
+            // Like findNode, the first child of each further tag. Same path elements
+            // never nest, so the first one starting inside the parent is its child
+            for(int tagNum = 0; tagNum < children.size() && match; tagNum++)
             {
-                curretNode = lists.at(cnt);
+                const QVector<qint64> &childRanges = children.at(tagNum);
+                int low = 0;
+                int high = childRanges.size() / 2;
 
-                for(int tagNum = 0; tagNum < tags.size() - 1; tagNum++)
+                while(low < high)
                 {
-                    curretNode = findNode(curretNode, tags.at(tagNum + 1));
+                    int mid = (low + high) / 2;
 
-                    // Not Found node
-                    if(curretNode.isNull())
+                    if(childRanges.at(2 * mid) <= begin)
                     {
-                        break;
+                        low = mid + 1;
                     }
-                }
-
-                // Found node
-                if(!curretNode.isNull())
-                {
-                    retNode = curretNode;
-
-                    if(index == foundNodeNum)
+                    else
                     {
-                        break;
+                        high = mid;
                     }
+                }
 
-                    foundNodeNum++;
+                match = (low < childRanges.size() / 2 && childRanges.at(2 * low) < end);
+
+                if(match)
+                {
+                    begin = childRanges.at(2 * low);
+                    end = childRanges.at(2 * low + 1);
                 }
             }
 
-        }
-        else if(1 == tags.size())
-        {
-            if(index < lists.size())
-            {
-                retNode = lists.at(index);
-            }
-            else
+            if(match)
             {
-                retNode = lists.at(0);
+                found.append(qMakePair(ranges.at(i), qMakePair(begin, end)));
             }
-
-            foundNodeNum = lists.size();
         }
     }
 
-    return retNode;
-}
+    // Document order of the first tag elements, as elementsByTagName lists them
+    qSort(found);
+
+    ret.reserve(found.size() * 2);
+    for(int i = 0; i < found.size(); i++)
+    {
+        ret.append(found.at(i).second.first);
+        ret.append(found.at(i).second.second);
+    }
 
+    m_indexQueries.insert(key, ret);
 
-int QtXmlOperation::getNodeCount(QString nodeNames)
+    return ret;
+}
+
+bool QtXmlOperation::refreshIndex()
 {
-    QDomNode retNode;
-    retNode.clear();
-    int foundNodeNum = 0;
+    if(NULL == m_file)
+    {
+        return false;
+    }
 
-    if(!nodeNames.isEmpty())
+    QFileInfo info(m_file->fileName());
+
+    if(!info.exists())
     {
-        // "\\W+", use any sequence of non-word characters as the separator
-        QStringList tags = nodeNames.split(QRegExp("\\W+"), QString::SkipEmptyParts);
-        QDomNodeList lists = m_doc->elementsByTagName(tags.at(0));
-        QDomNode curretNode;
+        return false;
+    }
 
-        if(tags.size() > 1)
-        {
-            for(int cnt = 0; cnt < lists.size(); cnt++)
-            {
-                curretNode = lists.at(cnt);
+    if(info.size() == m_fileSize && info.lastModified() == m_fileModified)
+    {
+        return true;
+    }
 
-                for(int tagNum = 0; tagNum < tags.size() - 1; tagNum++)
-                {
-                    curretNode = findNode(curretNode, tags.at(tagNum + 1));
+    QString errorStr = "";
 
-                    // Not Found node
-                    if(curretNode.isNull())
-                    {
-                        break;
-                    }
-                }
+    if(!reloadIndex(&errorStr))
+    {
+        qDebug() << "Error: Index refresh failed: " << qPrintable(errorStr);
 
-                // Found node
-                if(!curretNode.isNull())
-                {
-                    retNode = curretNode;
-                    foundNodeNum++;
-                }
-            }
+        // Keep the stale stamp, retry on the next read
+        return false;
+    }
+
+    updateFileStamp();
+
+    return true;
+}
+
+bool QtXmlOperation::readIndexedElement(QString nodeNames, int index, QDomDocument *fragment)
+{
+    bool ret = false;
 
+    QVector<qint64> ranges = findIndexNodes(nodeNames);
+    int count = ranges.size() / 2;
+
+    // Out of range like findNodeByNames: the first element for one tag, otherwise the last found
+    if(index < 0 || index >= count)
+    {
+        if(1 == nodeNames.split(QRegExp("\\W+"), QString::SkipEmptyParts).size())
+        {
+            index = (index < 0) ? -1 : 0;
         }
-        else if(1 == tags.size())
+        else
         {
-            foundNodeNum = lists.size();
+            index = count - 1;
         }
     }
 
-    return foundNodeNum;
+    if(NULL != m_file && index >= 0 && index < count)
+    {
+        qint64 begin = ranges.at(2 * index);
+        qint64 end = ranges.at(2 * index + 1);
+
+        QFile file(m_file->fileName());
+
+        if(file.open(QIODevice::ReadOnly) && file.seek(begin))
+        {
+            QByteArray content = m_indexProlog + file.read(end - begin);
+
+            ret = fragment->setContent(content, false);
+        }
+    }
+
+    return ret;
 }
 
-QDomElement QtXmlOperation::getRootElement()
+void QtXmlOperation::detachDocument()
 {
-    QDomElement root = m_doc->documentElement();
+    if(m_sharedDoc)
+    {
+        // Copy on first write, the cached tree stays untouched
+        QDomDocument copy = m_doc->cloneNode(true).toDocument();
+        *m_doc = copy;
+        m_sharedDoc = false;
+    }
+}
 
-    return root;
+void QtXmlOperation::recordInsert(QDomNode parent, QDomNode node)
+{
+    if(m_inTransaction)
+    {
+        UndoEntry entry;
+        entry.type = UndoInsert;
+        entry.parent = parent;
+        entry.node = node;
+        entry.doc = NULL;
+        entry.shared = false;
+        m_undoLog.append(entry);
+    }
 }
 
-QDomNode QtXmlOperation::findNode(QDomNode parentNode, QString childNodeName, bool preciseMatch)
+void QtXmlOperation::recordRemove(QDomNode parent, QDomNode node)
 {
-    QDomNode retNode;
-    retNode.clear();
+    if(m_inTransaction)
+    {
+        UndoEntry entry;
+        entry.type = UndoRemove;
+        entry.parent = parent;
+        entry.node = node;
+        entry.nextSibling = node.nextSibling();
+        entry.doc = NULL;
+        entry.shared = false;
+        m_undoLog.append(entry);
+    }
+}
 
-    if(!parentNode.isNull())
+void QtXmlOperation::recordAttributes(QDomElement element)
+{
+    if(m_inTransaction)
     {
-        if(preciseMatch)
+        UndoEntry entry;
+        entry.type = UndoAttributes;
+        entry.parent = element.cloneNode(false);    // Shallow copy still carries the attributes
+        entry.node = element;
+        entry.doc = NULL;
+        entry.shared = false;
+        m_undoLog.append(entry);
+    }
+}
+
+void QtXmlOperation::rollbackTo(int logSize)
+{
+    while(m_undoLog.size() > logSize)
+    {
+        UndoEntry entry = m_undoLog.takeLast();
+
+        if(UndoInsert == entry.type)
         {
-            retNode = parentNode.namedItem(childNodeName);
+            entry.parent.removeChild(entry.node);
         }
-        else
+        else if(UndoRemove == entry.type)
         {
-            QDomNodeList lists = parentNode.toElement().elementsByTagName(childNodeName);
+            // Later changes are already undone, so nextSibling is back in place
+            if(entry.nextSibling.isNull())
+            {
+                entry.parent.appendChild(entry.node);
+            }
+            else
+            {
+                entry.parent.insertBefore(entry.node, entry.nextSibling);
+            }
+        }
+        else if(UndoDocument == entry.type)
+        {
+            delete m_doc;
+            m_doc = entry.doc;
+            m_sharedDoc = entry.shared;
+        }
+        else if(UndoAttributes == entry.type)
+        {
+            QDomElement element = entry.node.toElement();
+            QDomNamedNodeMap changed = element.attributes();
 
-            if(!lists.isEmpty())
+            while(changed.count() > 0)
             {
-                retNode = lists.at(0);
+                element.removeAttributeNode(changed.item(0).toAttr());
+            }
+
+            QDomNamedNodeMap saved = entry.parent.attributes();
+            for(int i = 0; i < saved.count(); i++)
+            {
+                element.setAttribute(saved.item(i).nodeName(), saved.item(i).nodeValue());
             }
         }
     }
+}
 
-#ifdef ENABLE_DEBUG_TRACE_XML
-    QString str;
-    if(retNode.isNull())
+void QtXmlOperation::clearTransaction()
+{
+    QList<QDomDocument *> oldDocs;
+
+    for(int i = 0; i < m_undoLog.size(); i++)
     {
-         str = QString("findNode() not found parentNode.tagName() =%1 childNodeName = %2")
-                .arg(parentNode.toElement().tagName())
-                .arg(childNodeName);
+        if(UndoDocument == m_undoLog.at(i).type)
+        {
+            oldDocs.append(m_undoLog.at(i).doc);
+        }
     }
-    else
+
+    // Release node references before their documents
+    m_undoLog.clear();
+    qDeleteAll(oldDocs);
+
+    m_inTransaction = false;
+}
+
+bool QtXmlOperation::openFile(QString fileName)
+{
+    bool ret = false;
+
+    // The document is replaced, recorded changes can not be undone any more
+    clearTransaction();
+
+    if(NULL != m_file)
     {
-        str = QString("findNode() found parentNode.tagName() =%1 childNodeName = %2")
-                .arg(parentNode.toElement().tagName())
-                .arg(childNodeName);
+        if(m_file->isOpen())
+        {
+            m_file->close();
+        }
+        delete m_file;
     }
 
-    qDebug() << str;
-#endif
+    m_file = new QFile(fileName);
+    m_fileGeneration++;
 
-    return retNode;
+    ret = reopenFile();
+
+    return ret;
+}
+
+bool QtXmlOperation::reopenFile()
+{
+    bool ret = false;
+
+    if(m_file->isOpen())
+    {
+        m_file->close();
+    }
+
+    if(m_file->exists())
+    {
+        ret = m_file->open(QIODevice::ReadWrite | QIODevice::Text);
+
+        // Read only files can still be parsed, saveAs writes through its own QFile
+        if(!ret)
+        {
+            ret = m_file->open(QIODevice::ReadOnly | QIODevice::Text);
+        }
+    }
+
+    return ret;
 }
@@ -12,13 +12,50 @@ PURPOSE:        Provide XML read/write operation
 #include <QDomDocument>
 #include <QDomElement>
 #include <QFile>
-
+#include <QDateTime>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QFutureInterface>
+
+class QFileSystemWatcher;
+class QTimer;
+class QTextStream;
 
 class QtXmlOperation : public QObject
 {
     Q_OBJECT
 public:
 
+    enum ExportFormat
+    {
+        ExportCsv = 0,      // Header line plus one comma separated line per record
+        ExportJsonLines     // One JSON object per line per record
+    };
+
+    // Element filter of deleteAll/updateAll, context is passed through unchanged
+    typedef bool (*NodePredicate)(const QDomElement &element, void *context);
+
+    enum ParserType
+    {
+        ParserQDom = 0,     // QDomDocument::setContent, or QXmlStreamReader when a memory limit is set
+        ParserFast          // Byte scanner with SIMD search, UTF-8 input only, other input uses ParserQDom
+    };
+
+    // Memory held by a document, byte values are estimates
+    struct MemoryUsage
+    {
+        qint64 elements;        // Element nodes
+        qint64 attributes;      // Attribute nodes
+        qint64 texts;           // Text and CDATA nodes
+        qint64 others;          // Comments, processing instructions and other nodes
+        qint64 stringBytes;     // UTF-16 bytes of names, values and texts
+        qint64 indexBytes;      // Element index of openIndex
+        qint64 totalBytes;      // Estimated heap footprint including node overhead
+    };
+
     QtXmlOperation();
     QtXmlOperation(QString fileName);
     virtual ~QtXmlOperation();
@@ -51,6 +88,92 @@ public:
     bool openDocument(QString fileName);
 
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		openDocument
+    PURPOSE:		Open an xml file in disk with fileName, streams the file and only
+                    keeps elements under includePaths, ancestors are kept without
+                    their text. Like readText the first tag of a path matches at
+                    any depth ("root/Settings" or "Settings"). Fails when no
+                    element matches.
+    ARGUMENTS:		QString fileName, file name
+                    QStringList includePaths, node names of the subtrees to keep
+    RETURNS:		bool, true: successful, false: failed
+    -----------------------------------------------------------------------*/
+    bool openDocument(QString fileName, QStringList includePaths);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		openCachedDocument
+    PURPOSE:		Open an xml file through the process wide QtXmlDocumentCache, the
+                    parsed document is shared with other instances and copied on
+                    the first insert/delete/replace. The shared tree is always built
+                    by QDomDocument::setContent whatever setParserType says, the
+                    memory limit is checked against the cached tree after parsing
+                    and fails the open when exceeded.
+    ARGUMENTS:		QString fileName, file name
+    RETURNS:		bool, true: successful, false: failed
+    -----------------------------------------------------------------------*/
+    bool openCachedDocument(QString fileName);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		validateDocument
+    PURPOSE:		Check an xml file in disk is well-formed by streaming it, no DOM is
+                    built and nothing is written
+    ARGUMENTS:		QString fileName, file name
+                    QStringList requiredPaths, node names that must exist, matched like
+                    getNodeCount (example: "root/Settings" or "Settings"), missing ones
+                    are listed in errorStr, empty means no check
+                    int maxElements, maximum number of elements, 0 means no limit
+                    QString *errorStr, int *errorLine, int *errorColumn, error info
+    RETURNS:		bool, true: valid, false: invalid
+    -----------------------------------------------------------------------*/
+    static bool validateDocument(QString fileName, QStringList requiredPaths = QStringList(), int maxElements = 0,
+                                 QString *errorStr = NULL, int *errorLine = NULL, int *errorColumn = NULL);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		exportRecords
+    PURPOSE:		Stream repeated record elements of an xml file in disk into CSV or
+                    JSON lines in one pass, only one record is held in memory.
+                    Column examples: "@Value" attribute of the record, "Name" text of
+                    child element, "Name/@Unit" attribute of child, "." text of record
+    ARGUMENTS:		QString fileName, xml file name
+                    QString recordPath, node names of the record, like readAll it may start
+                    at any depth (example: "WorkItemResult/Progress" or "Progress"), a
+                    match inside a record belongs to that record
+                    QStringList columns, column mapping
+                    QString outputName, output file name
+                    ExportFormat format, output format
+                    QString *errorStr, error info
+    RETURNS:		qint64, number of records exported, -1: failed or no record found,
+                    no output file is left behind then
+    -----------------------------------------------------------------------*/
+    static qint64 exportRecords(QString fileName, QString recordPath, QStringList columns, QString outputName,
+                                ExportFormat format = ExportCsv, QString *errorStr = NULL);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		splitDocument
+    PURPOSE:		Split an xml file in disk into shards with the same root element,
+                    streaming it once. Children of the root before the first record and
+                    after the last record are copied into every shard, the children
+                    between are distributed in order. Shards are written concurrently, as "outputName_0001.xml" etc.
+                    (suffix of outputName kept). On failure no shard is left behind.
+    ARGUMENTS:		QString fileName, xml file name, UTF-8 or another ASCII compatible encoding
+                    QString recordName, tag name of the repeated root children (example:
+                    "Progress"), empty means every root child is a record
+                    QString outputName, output file name the shard number is added to
+                    int recordsPerShard, start a new shard after this many records, 0: no limit
+                    qint64 bytesPerShard, start a new shard before a record would make it larger,
+                    header and footer included, a single record may still exceed it. 0: no limit
+                    QString *errorStr, error info
+    RETURNS:		int, number of shards written, -1: failed
+    -----------------------------------------------------------------------*/
+    static int splitDocument(QString fileName, QString recordName, QString outputName, int recordsPerShard,
+                             qint64 bytesPerShard = 0, QString *errorStr = NULL);
+
+
     /*-----------------------------------------------------------------------
     FUNCTION:		saveAs
     PURPOSE:		Save to .xml file to disk with fileName
@@ -60,6 +183,53 @@ public:
     bool saveAs(QString fileName);
 
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		openDocumentAsync
+    PURPOSE:		Parse an xml file in background, the document is swapped in when
+                    done and loaded() or failed() is emitted. Async operations of one
+                    instance run one after another in call order. Synchronous calls
+                    are not queued, they act on the current document at once and
+                    changes made before the swap are replaced like by openDocument.
+                    Fails at once during a transaction.
+    ARGUMENTS:		QString fileName, file name
+    RETURNS:		QFuture<bool>, finished after the swap, result true: successful
+    -----------------------------------------------------------------------*/
+    QFuture<bool> openDocumentAsync(QString fileName);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		saveAsync
+    PURPOSE:		Save the document as it is now in background, saved() or failed()
+                    is emitted when done. Later changes copy the document first.
+    ARGUMENTS:		QString fileName, file name
+    RETURNS:		QFuture<bool>, result true: successful
+    -----------------------------------------------------------------------*/
+    QFuture<bool> saveAsync(QString fileName);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		openIndex
+    PURPOSE:		Open an xml file in disk for random access without building the DOM.
+                    An element byte offset index is kept in "fileName.idx" and reused
+                    while file size and modification time are unchanged. Afterwards
+                    readText/readAttribute/getNodeCount only parse the requested element
+                    and match node names the same way as with a DOM. Only the path list
+                    is read at open, offsets of a path are read on first use.
+    ARGUMENTS:		QString fileName, file name
+    RETURNS:		bool, true: successful, false: failed
+    -----------------------------------------------------------------------*/
+    bool openIndex(QString fileName);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		isIndexed
+    PURPOSE:		Check whether the file is opened by openIndex
+    ARGUMENTS:		None
+    RETURNS:		bool, true: indexed, false: not indexed
+    -----------------------------------------------------------------------*/
+    bool isIndexed();
+
+
     /*-----------------------------------------------------------------------
     FUNCTION:		isFileExist
     PURPOSE:		Check wheter the xml file exist
@@ -99,6 +269,27 @@ public:
     QString readAttribute(QString nodeName, QString attrName, int nodeIndex = 0);
 
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		readAll
+    PURPOSE:		Get Text string or attribute of every element matching node names
+                    in one pass. Unlike readText all children on each level match,
+                    "root/Progress" means every Progress child of every root element
+    ARGUMENTS:		QString nodeNames, node names
+                    QString attrName, attribute name, empty: read the text
+    RETURNS:		QStringList, one entry per element in document order
+    -----------------------------------------------------------------------*/
+    QStringList readAll(QString nodeNames, QString attrName = QString());
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		countAll
+    PURPOSE:		Count every element matching node names, same matching as readAll
+    ARGUMENTS:		QString nodeNames, node names
+    RETURNS:		int, number of elements
+    -----------------------------------------------------------------------*/
+    int countAll(QString nodeNames);
+
+
     /*-----------------------------------------------------------------------
     FUNCTION:		insertNode
     PURPOSE:		Insert a node element
@@ -137,32 +328,645 @@ public:
     bool replaceNode(QString parentNodeName, QString nodeName, QString nodeText, QStringList attrNames, QStringList attrs, int parentIndex = 0);
 
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		deleteAll
+    PURPOSE:		Delete every element matching node names in one pass. Unlike
+                    deleteNode all children on each level match, "root/Progress"
+                    means every Progress child of every root element
+    ARGUMENTS:		QString nodeNames, node names (example: "root/abc/123")
+                    NodePredicate predicate, delete only elements it accepts, NULL: all
+                    void *context, passed to predicate
+    RETURNS:		int, number of deleted elements
+    -----------------------------------------------------------------------*/
+    int deleteAll(QString nodeNames, NodePredicate predicate = NULL, void *context = NULL);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		updateAll
+    PURPOSE:		Set attributes and text of every element matching node names in
+                    one pass, matching as deleteAll
+    ARGUMENTS:		QString nodeNames, node names (example: "root/abc/123")
+                    QStringList attrNames, attribute names to set
+                    QStringList attrs, attribute values, missing values are set to ""
+                    QString nodeText, replaces the text children, null QString: keep text
+                    NodePredicate predicate, update only elements it accepts, NULL: all
+                    void *context, passed to predicate
+    RETURNS:		int, number of updated elements
+    -----------------------------------------------------------------------*/
+    int updateAll(QString nodeNames, QStringList attrNames, QStringList attrs, QString nodeText = QString(),
+                  NodePredicate predicate = NULL, void *context = NULL);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		beginTransaction
+    PURPOSE:		Start recording changes so they can be rolled back, only the
+                    changed nodes are recorded, not a copy of the document
+    ARGUMENTS:		None
+    RETURNS:		bool, true: successful, false: a transaction is already active
+                    or an openDocumentAsync is pending (its swap would drop it)
+    -----------------------------------------------------------------------*/
+    bool beginTransaction();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		commitTransaction
+    PURPOSE:		Keep the changes since beginTransaction
+    ARGUMENTS:		None
+    RETURNS:		bool, true: successful, false: no active transaction
+    -----------------------------------------------------------------------*/
+    bool commitTransaction();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		rollbackTransaction
+    PURPOSE:		Undo the changes since beginTransaction, cost depends on the
+                    number of changes only
+    ARGUMENTS:		None
+    RETURNS:		bool, true: successful, false: no active transaction
+    -----------------------------------------------------------------------*/
+    bool rollbackTransaction();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		isInTransaction
+    PURPOSE:		Check whether a transaction is active
+    ARGUMENTS:		None
+    RETURNS:		bool, true: active, false: not active
+    -----------------------------------------------------------------------*/
+    bool isInTransaction();
+
+
     /*-----------------------------------------------------------------------
     FUNCTION:		getNodeCount
-    PURPOSE:		Get the count of node by node names (names example: "root/abc/123")
+    PURPOSE:		Get the count of node by node names (names example: "root/abc/123").
+                    Only the first matching child under each parent counts, countAll
+                    counts every matching element
     ARGUMENTS:		QString nodeNames, node names
     RETURNS:		int, the number of node
     -----------------------------------------------------------------------*/
     int getNodeCount(QString nodeNames);
 
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		getMemoryUsage
+    PURPOSE:		Get node counts and estimated memory held by this instance
+    ARGUMENTS:		None
+    RETURNS:		MemoryUsage
+    -----------------------------------------------------------------------*/
+    MemoryUsage getMemoryUsage();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		measureDocument
+    PURPOSE:		Get node counts and estimated memory of a document
+    ARGUMENTS:		QDomDocument doc, document to measure
+    RETURNS:		MemoryUsage
+    -----------------------------------------------------------------------*/
+    static MemoryUsage measureDocument(QDomDocument doc);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setMemoryLimit
+    PURPOSE:		Set the hard limit of the estimated document memory, parsing stops
+                    and openDocument/openDocumentAsync fail once it is exceeded. The
+                    tree is the same as without a limit, a document with a DOCTYPE
+                    is parsed by setContent and checked once built.
+    ARGUMENTS:		qint64 bytes, limit in bytes, 0 means no limit
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setMemoryLimit(qint64 bytes);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		memoryLimit
+    PURPOSE:		Get the hard limit of the estimated document memory
+    ARGUMENTS:		None
+    RETURNS:		qint64, limit in bytes, 0 means no limit
+    -----------------------------------------------------------------------*/
+    qint64 memoryLimit();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setParserType
+    PURPOSE:		Select the parser used by openDocument, openDocumentAsync and watch reloads
+    ARGUMENTS:		ParserType type, parser, ParserQDom by default
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setParserType(ParserType type);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		parserType
+    PURPOSE:		Get the parser used by openDocument
+    ARGUMENTS:		None
+    RETURNS:		ParserType
+    -----------------------------------------------------------------------*/
+    ParserType parserType();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setReadChunkSize
+    PURPOSE:		Set the bytes ParserFast reads at once, small sizes split tokens
+                    across reads, which the parser test uses
+    ARGUMENTS:		int bytes, chunk size, 0 means the default of 1 MB
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setReadChunkSize(int bytes);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		readChunkSize
+    PURPOSE:		Get the bytes ParserFast reads at once
+    ARGUMENTS:		None
+    RETURNS:		int, 0 means the default
+    -----------------------------------------------------------------------*/
+    int readChunkSize();
+
+
     /*-----------------------------------------------------------------------
     FUNCTION:		getRootElement
-    PURPOSE:		Get the root element reference
+    PURPOSE:		Get the root element reference, read only after openCachedDocument
     ARGUMENTS:		None
     RETURNS:		QDomElement, return a root reference
     -----------------------------------------------------------------------*/
     QDomElement getRootElement();
 
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setWatchEnabled
+    PURPOSE:		Watch the opened xml file and reload it in background when
+                    its size, modification time or content hash changed.
+                    Rapid writes are debounced into one reload.
+    ARGUMENTS:		bool enable, true: start watching, false: stop watching
+                    int debounceMs, quiet time after the last change before reloading
+    RETURNS:		bool, true: successful, false: no opened file to watch
+    -----------------------------------------------------------------------*/
+    bool setWatchEnabled(bool enable, int debounceMs = 500);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		isWatchEnabled
+    PURPOSE:		Check whether watch mode is enabled
+    ARGUMENTS:		None
+    RETURNS:		bool, true: enabled, false: disabled
+    -----------------------------------------------------------------------*/
+    bool isWatchEnabled();
+
     
 signals:
+    // Emitted after a changed file was reparsed and the new document swapped in
+    void documentReloaded(QString fileName);
+
+    // Emitted when openDocumentAsync/saveAsync finished
+    void loaded(QString fileName);
+    void saved(QString fileName);
+    void failed(QString fileName, QString errorStr);
     
 public slots:
 
+private slots:
+    void onWatchedFileChanged(QString fileName);
+    void onReloadTimeout();
+    void onReloadFinished();
+    void onAsyncFinished();
+
 private:
+    // Background reload input, the stamp of the current document and how to parse
+    struct ReloadRequest
+    {
+        QString fileName;
+        int generation;         // m_fileGeneration when the reload started
+        qint64 fileSize;
+        QDateTime fileModified;
+        QByteArray fileHash;
+        QStringList includePaths;
+        qint64 memoryLimit;
+        ParserType parserType;
+        int chunkSize;
+    };
+
+    // Result of a background reload, doc is NULL when nothing changed or parse failed
+    struct ReloadResult
+    {
+        QDomDocument *doc;
+        int generation;         // Copied from the request
+        qint64 fileSize;
+        QDateTime fileModified;
+        QByteArray fileHash;
+    };
+
+    // Queued openDocumentAsync/saveAsync call
+    struct AsyncOperation
+    {
+        bool save;
+        QString fileName;
+        QDomDocument doc;       // Snapshot to save
+        bool wasShared;         // m_sharedDoc before the snapshot was taken
+        QFutureInterface<bool> promise;
+    };
+
+    // Result of a background load or save, doc is the loaded document or NULL
+    struct AsyncResult
+    {
+        QDomDocument *doc;
+        bool ok;
+        QString errorStr;
+    };
+
+    // Change recorded in a transaction
+    enum UndoType
+    {
+        UndoInsert = 0,     // node was appended to parent
+        UndoRemove,         // node was removed from parent before nextSibling
+        UndoDocument,       // m_doc was replaced, doc is the previous document
+        UndoAttributes      // attributes of node were changed, parent is a copy holding the old ones
+    };
+
+    struct UndoEntry
+    {
+        UndoType type;
+        QDomNode parent;
+        QDomNode node;
+        QDomNode nextSibling;
+        QDomDocument *doc;
+        bool shared;
+    };
+
     QDomDocument *m_doc;
     QFile *m_file;
 
+    // Bumped by openFile, a reload started for an older file is dropped
+    int m_fileGeneration;
+
+    // m_doc shares its tree with QtXmlDocumentCache or a pending saveAsync, copy before writing
+    bool m_sharedDoc;
+
+    // Transaction
+    bool m_inTransaction;
+    QList<UndoEntry> m_undoLog;
+
+    // Subtrees kept by openDocument(fileName, includePaths), empty means whole document
+    QStringList m_includePaths;
+
+    // Element index of openIndex. Every full path ("root/abc/123") with the position of
+    // its offsets in "fileName.idx" (-1: kept in RAM only), and the begin/end byte
+    // offset pairs loaded so far, a path is read from the index file on first use
+    QHash<QString, qint64> m_indexPaths;
+    QHash<QString, QVector<qint64> > m_index;
+    QHash<QString, QVector<qint64> > m_indexQueries;    // Offset pairs of node names looked up before
+    QByteArray m_indexProlog;   // Bytes before the root element, parsed with every element
+    bool m_indexed;
+
+    // Hard limit of estimated document memory, 0 means no limit
+    qint64 m_memoryLimit;
+
+    ParserType m_parserType;
+    int m_readChunkSize;
+
+    // Watch mode
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_reloadTimer;
+    QFutureWatcher<ReloadResult> *m_reloadWatcher;
+    bool m_reloadRunning;
+    bool m_reloadPending;
+
+    // Stamp of the file content currently held in m_doc
+    qint64 m_fileSize;
+    QDateTime m_fileModified;
+    QByteArray m_fileHash;
+
+    // Async operations, the first one is running
+    QList<AsyncOperation> m_asyncQueue;
+    QFutureWatcher<AsyncResult> *m_asyncWatcher;
+    bool m_asyncRunning;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		reloadFile
+    PURPOSE:		Reparse a file if it differs from the given stamp, run in worker thread
+    ARGUMENTS:		ReloadRequest request, file name, stamp of the current document
+                    (hash may be empty) and parse options
+    RETURNS:		ReloadResult, doc is a new document on change or NULL
+    -----------------------------------------------------------------------*/
+    static ReloadResult reloadFile(ReloadRequest request);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		parseFiltered
+    PURPOSE:		Stream device into doc, keeping only elements under includePaths
+    ARGUMENTS:		QIODevice *device, opened input device
+                    QDomDocument *doc, cleared target document
+                    QStringList includePaths, node names of the subtrees to keep, empty means all
+                    qint64 memoryLimit, fail once the estimated memory exceeds it, 0 means no limit
+                    QString *errorStr, int *errorLine, int *errorColumn, error info
+                    bool *unsupported, NULL: skip a DOCTYPE and keep unresolved entities out,
+                    otherwise set and fail when the input has a DOCTYPE or entity reference
+    RETURNS:		bool, true: successful, false: failed
+    -----------------------------------------------------------------------*/
+    static bool parseFiltered(QIODevice *device, QDomDocument *doc, QStringList includePaths, qint64 memoryLimit,
+                              QString *errorStr, int *errorLine, int *errorColumn, bool *unsupported = NULL);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		parseDocument
+    PURPOSE:		Parse the whole device into doc with the selected parser
+    ARGUMENTS:		QIODevice *device, opened input device
+                    QDomDocument *doc, cleared target document
+                    ParserType parserType, parser to use
+                    qint64 memoryLimit, fail once the estimated memory exceeds it, 0 means no limit
+                    int chunkSize, bytes ParserFast reads at once, 0 means the default
+                    QString *errorStr, int *errorLine, int *errorColumn, error info
+    RETURNS:		bool, true: successful, false: failed
+    -----------------------------------------------------------------------*/
+    static bool parseDocument(QIODevice *device, QDomDocument *doc, ParserType parserType, qint64 memoryLimit,
+                              int chunkSize, QString *errorStr, int *errorLine, int *errorColumn);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		parseFast
+    PURPOSE:		Build doc from QtXmlScanner tokens, same tree as QDomDocument::setContent
+                    without namespace processing
+    ARGUMENTS:		QIODevice *device, opened UTF-8 input device
+                    QDomDocument *doc, cleared target document
+                    qint64 memoryLimit, fail once the estimated memory exceeds it, 0 means no limit
+                    int chunkSize, bytes read at once, 0 means the default
+                    bool *unsupported, set when the input needs a DTD (DOCTYPE) or has
+                    non-ASCII names, doc is not built
+                    QString *errorStr, int *errorLine, int *errorColumn, error info
+    RETURNS:		bool, true: successful, false: failed
+    -----------------------------------------------------------------------*/
+    static bool parseFast(QIODevice *device, QDomDocument *doc, qint64 memoryLimit, int chunkSize, bool *unsupported,
+                          QString *errorStr, int *errorLine, int *errorColumn);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		isUtf8Document
+    PURPOSE:		Check byte order mark and declared encoding without consuming input
+    ARGUMENTS:		QIODevice *device, opened input device
+    RETURNS:		bool, true: UTF-8 or ASCII, false: other encoding
+    -----------------------------------------------------------------------*/
+    static bool isUtf8Document(QIODevice *device);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		loadIndex
+    PURPOSE:		Load the path directory of "fileName.idx" if it matches the file, the
+                    offsets stay on disk. Otherwise scan the file, keep the whole index
+                    and write it.
+    ARGUMENTS:		QString fileName, xml file name
+                    QHash<QString, qint64> *paths, output full paths and their position in
+                    the index file, -1 when only in index
+                    QHash<QString, QVector<qint64> > *index, output offsets, empty when
+                    loaded from the index file
+                    QByteArray *prolog, output bytes before the root element
+                    QString *errorStr, error info
+    RETURNS:		bool, true: successful, false: failed
+    -----------------------------------------------------------------------*/
+    static bool loadIndex(QString fileName, QHash<QString, qint64> *paths, QHash<QString, QVector<qint64> > *index,
+                          QByteArray *prolog, QString *errorStr);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		scanIndex
+    PURPOSE:		Scan device and record byte offsets of every element by its full path
+    ARGUMENTS:		QIODevice *device, opened input device
+                    QHash<QString, QVector<qint64> > *index, output index
+                    QByteArray *prolog, output bytes before the root element
+                    QString *errorStr, error info
+    RETURNS:		bool, true: successful, false: failed
+    -----------------------------------------------------------------------*/
+    static bool scanIndex(QIODevice *device, QHash<QString, QVector<qint64> > *index, QByteArray *prolog,
+                          QString *errorStr);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		reloadIndex
+    PURPOSE:		Load the index of the open file, drops the looked up node names
+    ARGUMENTS:		QString *errorStr, error info
+    RETURNS:		bool, true: successful, false: failed, index cleared
+    -----------------------------------------------------------------------*/
+    bool reloadIndex(QString *errorStr);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		clearIndex
+    PURPOSE:		Drop the index and leave indexed mode
+    ARGUMENTS:		None
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void clearIndex();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		indexRanges
+    PURPOSE:		Get begin/end offset pairs of one full path, read from the index
+                    file on first use
+    ARGUMENTS:		QString path, full path from root
+    RETURNS:		QVector<qint64>, begin/end pairs in document order, empty if unknown
+    -----------------------------------------------------------------------*/
+    QVector<qint64> indexRanges(QString path);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		findIndexRanges
+    PURPOSE:		Get begin/end offset pairs of node names like findAllByNames, every
+                    full path ending with them matches. Results are kept until the
+                    index changes.
+    ARGUMENTS:		QString nodeNames, node names
+    RETURNS:		QVector<qint64>, begin/end pairs in document order
+    -----------------------------------------------------------------------*/
+    QVector<qint64> findIndexRanges(QString nodeNames);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		findIndexNodes
+    PURPOSE:		Get begin/end offset pairs of node names like findNodeByNames: every
+                    element named by the first tag, then its first child of each further
+                    tag. Results are kept until the index changes.
+    ARGUMENTS:		QString nodeNames, node names
+    RETURNS:		QVector<qint64>, begin/end pairs in the order findNodeByNames counts
+    -----------------------------------------------------------------------*/
+    QVector<qint64> findIndexNodes(QString nodeNames);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		refreshIndex
+    PURPOSE:		Rebuild the index when the file changed since it was built,
+                    stored offsets of a rewritten file point at wrong elements
+    ARGUMENTS:		None
+    RETURNS:		bool, true: index matches the file, false: file missing or index failed
+    -----------------------------------------------------------------------*/
+    bool refreshIndex();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		readIndexedElement
+    PURPOSE:		Seek to an indexed element and parse only this element after the
+                    prolog, so encoding and entities of the file apply. The element is
+                    selected like findNodeByNames, including its out of range index.
+    ARGUMENTS:		QString nodeNames, node names
+                    int index, node index(from 0 to n)
+                    QDomDocument *fragment, document holding the element as root
+    RETURNS:		bool, true: successful, false: not found or parse failed
+    -----------------------------------------------------------------------*/
+    bool readIndexedElement(QString nodeNames, int index, QDomDocument *fragment);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		detachDocument
+    PURPOSE:		Copy a shared document before it is modified
+    ARGUMENTS:		None
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void detachDocument();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		recordInsert
+    PURPOSE:		Record that node was appended to parent, if in transaction
+    ARGUMENTS:		QDomNode parent, parent node
+                    QDomNode node, inserted node
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void recordInsert(QDomNode parent, QDomNode node);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		recordRemove
+    PURPOSE:		Record that node is going to be removed from parent, if in transaction
+    ARGUMENTS:		QDomNode parent, parent node
+                    QDomNode node, node to be removed
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void recordRemove(QDomNode parent, QDomNode node);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		recordAttributes
+    PURPOSE:		Record the attributes of element before they are changed, if in transaction
+    ARGUMENTS:		QDomElement element, element to be changed
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void recordAttributes(QDomElement element);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		rollbackTo
+    PURPOSE:		Undo recorded changes in reverse order until logSize entries are left
+    ARGUMENTS:		int logSize, number of entries to keep
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void rollbackTo(int logSize);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		clearTransaction
+    PURPOSE:		Drop the undo log and end the transaction
+    ARGUMENTS:		None
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void clearTransaction();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		openFile
+    PURPOSE:		Replace m_file by fileName and open it
+    ARGUMENTS:		QString fileName, file name
+    RETURNS:		bool, true: file exists and opened, false: failed
+    -----------------------------------------------------------------------*/
+    bool openFile(QString fileName);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		reopenFile
+    PURPOSE:		Close and open m_file again, read only when it is not writable
+    ARGUMENTS:		None
+    RETURNS:		bool, true: file exists and opened, false: failed
+    -----------------------------------------------------------------------*/
+    bool reopenFile();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		loadFile
+    PURPOSE:		Parse fileName into a new document, run in worker thread
+    ARGUMENTS:		QString fileName, file name
+                    qint64 memoryLimit, fail once the estimated memory exceeds it, 0 means no limit
+                    ParserType parserType, parser to use
+                    int chunkSize, bytes ParserFast reads at once, 0 means the default
+    RETURNS:		AsyncResult, doc is the new document on success or NULL
+    -----------------------------------------------------------------------*/
+    static AsyncResult loadFile(QString fileName, qint64 memoryLimit, ParserType parserType, int chunkSize);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		saveFile
+    PURPOSE:		Save doc to fileName, run in worker thread
+    ARGUMENTS:		QString fileName, file name
+                    QDomDocument doc, document to save
+    RETURNS:		AsyncResult, doc is always NULL
+    -----------------------------------------------------------------------*/
+    static AsyncResult saveFile(QString fileName, QDomDocument doc);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		saveDocument
+    PURPOSE:		Save doc to .xml file to disk with fileName
+    ARGUMENTS:		QDomDocument doc, document to save
+                    QString fileName, file name
+                    QString *errorStr, error info
+    RETURNS:		bool, true: successful, false: failed
+    -----------------------------------------------------------------------*/
+    static bool saveDocument(QDomDocument doc, QString fileName, QString *errorStr = NULL);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		writeRecord
+    PURPOSE:		Write one exported record
+    ARGUMENTS:		QTextStream &stream, output stream
+                    QStringList columns, column names
+                    QStringList values, column values
+                    ExportFormat format, output format
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    static void writeRecord(QTextStream &stream, QStringList columns, QStringList values, ExportFormat format);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		writeShard
+    PURPOSE:		Write one shard of splitDocument, run in worker thread
+    ARGUMENTS:		QString fileName, shard file name
+                    QByteArray head, prolog, root start tag and shared children
+                    QByteArray body, records of this shard
+                    QByteArray tail, children after the last record and root end tag
+    RETURNS:		QString, error info, empty on success
+    -----------------------------------------------------------------------*/
+    static QString writeShard(QString fileName, QByteArray head, QByteArray body, QByteArray tail);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		replaceShardTail
+    PURPOSE:		Replace the last bytes of a written shard, run in worker thread
+    ARGUMENTS:		QString fileName, shard file name
+                    int tailSize, number of bytes to replace
+                    QByteArray tail, new end of the shard
+    RETURNS:		QString, error info, empty on success
+    -----------------------------------------------------------------------*/
+    static QString replaceShardTail(QString fileName, int tailSize, QByteArray tail);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		measureSplitFooter
+    PURPOSE:		Get the bytes splitDocument writes for the root children after the
+                    last record, streaming the device once
+    ARGUMENTS:		QIODevice *device, opened input device at the start
+                    QByteArray record, tag name of the records, empty means every root child
+    RETURNS:		qint64, footer bytes
+    -----------------------------------------------------------------------*/
+    static qint64 measureSplitFooter(QIODevice *device, QByteArray record);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		startAsyncOperation
+    PURPOSE:		Start the first queued async operation if none is running
+    ARGUMENTS:		None
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void startAsyncOperation();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		isOpenPending
+    PURPOSE:		Check whether an openDocumentAsync is queued or running
+    ARGUMENTS:		None
+    RETURNS:		bool, true: pending, false: none
+    -----------------------------------------------------------------------*/
+    bool isOpenPending();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		updateFileStamp
+    PURPOSE:		Record size and modification time of m_file, hash is reset
+    ARGUMENTS:		None
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void updateFileStamp();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		updateWatchPath
+    PURPOSE:		Make the file watcher follow m_file
+    ARGUMENTS:		None
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void updateWatchPath();
+
     /*-----------------------------------------------------------------------
     FUNCTION:		findNodeByNames
     PURPOSE:		Find node reference by node names (names example: "root/abc/123")
@@ -172,6 +976,18 @@ private:
     -----------------------------------------------------------------------*/
     QDomNode findNodeByNames(QString nodeNames, int index = 0);
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		findAllByNames
+    PURPOSE:		Collect every element whose tag path ends with node names in one
+                    document traversal
+    ARGUMENTS:		QString nodeNames, node names
+                    NodePredicate predicate, keep only elements it accepts, NULL: all
+                    void *context, passed to predicate
+                    bool skipMatched, do not search below a collected element
+    RETURNS:		QList<QDomElement>, elements in document order
+    -----------------------------------------------------------------------*/
+    QList<QDomElement> findAllByNames(QString nodeNames, NodePredicate predicate, void *context, bool skipMatched);
+
     /*-----------------------------------------------------------------------
     FUNCTION:		findNode
     PURPOSE:		Find node reference by parent node and node name
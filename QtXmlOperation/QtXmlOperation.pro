@@ -10,13 +10,14 @@ QT += xml
 TARGET = QtXmlOperation
 TEMPLATE = app
 
+# QtXmlOperation class, built by QtXmlCore.pro (see QtXml.pro)
+include(QtXmlCore.pri)
+
 
 SOURCES += main.cpp\
-        MainWindow.cpp \
-    QtXmlOperation.cpp
+        MainWindow.cpp
 
-HEADERS  += MainWindow.h \
-    QtXmlOperation.h
+HEADERS  += MainWindow.h
 
 FORMS    += MainWindow.ui
 
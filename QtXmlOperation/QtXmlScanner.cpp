@@ -0,0 +1,380 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           QtXmlScanner.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Byte level XML markup scanner, reports every token with
+                its byte range in the input device
+**********************************************************************/
+
+#include "QtXmlScanner.h"
+#include "QtXmlSimd.h"
+#include <string.h>
+
+#define XML_SCANNER_CHUNK_SIZE  (1024 * 1024)
+
+QtXmlScanner::QtXmlScanner(QIODevice *device, int chunkSize) :
+    m_device(device),
+    m_chunkSize((chunkSize > 0) ? chunkSize : XML_SCANNER_CHUNK_SIZE),
+    m_bufferBase(0),
+    m_pos(0),
+    m_atEnd(false),
+    m_utf8Check(false),
+    m_utf8Pos(0),
+    m_utf8Error(false),
+    m_type(NoToken),
+    m_tokenBegin(0),
+    m_tokenEnd(0)
+{
+    m_buffer.clear();
+
+    if(NULL != m_device)
+    {
+        m_bufferBase = m_device->pos();
+    }
+    else
+    {
+        m_atEnd = true;
+    }
+}
+
+QtXmlScanner::~QtXmlScanner()
+{
+}
+
+QtXmlScanner::TokenType QtXmlScanner::readNext()
+{
+    if(Error == m_type || EndOfFile == m_type)
+    {
+        return m_type;
+    }
+
+    m_name.clear();
+
+    if(m_pos >= m_buffer.size() && !fill())
+    {
+        if(m_utf8Error)
+        {
+            return setError(QString("Invalid UTF-8 near offset %1").arg(m_bufferBase + m_utf8Pos));
+        }
+
+        m_type = EndOfFile;
+        m_tokenBegin = m_pos;
+        m_tokenEnd = m_pos;
+
+        return m_type;
+    }
+
+    // Only the incomplete tail of a UTF-8 sequence is left, complete it first
+    while(m_utf8Check && !m_utf8Error && m_utf8Pos <= m_pos && fill())
+    {
+    }
+
+    if(m_utf8Error)
+    {
+        return setError(QString("Invalid UTF-8 near offset %1").arg(m_bufferBase + m_utf8Pos));
+    }
+
+    // Character data up to the next markup or the end of the buffer
+    if('<' != m_buffer.at(m_pos))
+    {
+        int end = QtXmlSimd::findByte(m_buffer.constData() + m_pos, m_buffer.size() - m_pos, '<');
+
+        if(end < 0)
+        {
+            // Never split a UTF-8 sequence between two text tokens
+            end = m_utf8Check ? m_utf8Pos : m_buffer.size();
+        }
+        else
+        {
+            end += m_pos;
+        }
+
+        m_type = Text;
+        m_tokenBegin = m_pos;
+        m_tokenEnd = end;
+        m_pos = end;
+
+        return m_type;
+    }
+
+    // Longest markup start to classify is "<![CDATA["
+    while(m_buffer.size() - m_pos < 9 && fill())
+    {
+    }
+
+    const char *p = m_buffer.constData() + m_pos;
+    int avail = m_buffer.size() - m_pos;
+    TokenType type = NoToken;
+    int end = -1;
+
+    if(avail >= 2 && 0 == memcmp(p, "<?", 2))
+    {
+        type = ProcessingInstruction;
+        end = findMarkupEnd("?>", 2);
+    }
+    else if(avail >= 4 && 0 == memcmp(p, "<!--", 4))
+    {
+        type = Comment;
+        end = findMarkupEnd("-->", 4);
+    }
+    else if(avail >= 9 && 0 == memcmp(p, "<![CDATA[", 9))
+    {
+        type = CData;
+        end = findMarkupEnd("]]>", 9);
+    }
+    else if(avail >= 2 && 0 == memcmp(p, "<!", 2))
+    {
+        type = Declaration;
+        end = findMarkupEnd(NULL, 2);
+    }
+    else if(avail >= 2 && 0 == memcmp(p, "</", 2))
+    {
+        type = EndElement;
+        end = findMarkupEnd(NULL, 2);
+    }
+    else
+    {
+        type = StartElement;
+        end = findMarkupEnd(NULL, 1);
+    }
+
+    if(m_utf8Error)
+    {
+        return setError(QString("Invalid UTF-8 near offset %1").arg(m_bufferBase + m_utf8Pos));
+    }
+
+    if(end < 0)
+    {
+        return setError(QString("Unexpected end of file at offset %1").arg(m_bufferBase + m_pos));
+    }
+
+    m_type = type;
+    m_tokenBegin = m_pos;
+    m_tokenEnd = end;
+    m_pos = end;
+
+    if(StartElement == m_type || EndElement == m_type)
+    {
+        const char *data = m_buffer.constData();
+
+        if(StartElement == m_type && '/' == data[m_tokenEnd - 2])
+        {
+            m_type = EmptyElement;
+        }
+
+        int nameBegin = m_tokenBegin + ((EndElement == m_type) ? 2 : 1);
+        int nameEnd = nameBegin;
+
+        while(nameEnd < m_tokenEnd)
+        {
+            char c = data[nameEnd];
+
+            if(' ' == c || '\t' == c || '\r' == c || '\n' == c || '/' == c || '>' == c)
+            {
+                break;
+            }
+
+            nameEnd++;
+        }
+
+        if(nameEnd == nameBegin)
+        {
+            return setError(QString("Missing tag name at offset %1").arg(tokenBegin()));
+        }
+
+        m_name = m_buffer.mid(nameBegin, nameEnd - nameBegin);
+    }
+
+    return m_type;
+}
+
+QtXmlScanner::TokenType QtXmlScanner::tokenType()
+{
+    return m_type;
+}
+
+qint64 QtXmlScanner::tokenBegin()
+{
+    return m_bufferBase + m_tokenBegin;
+}
+
+qint64 QtXmlScanner::tokenEnd()
+{
+    return m_bufferBase + m_tokenEnd;
+}
+
+QByteArray QtXmlScanner::tokenData()
+{
+    return QByteArray::fromRawData(m_buffer.constData() + m_tokenBegin, m_tokenEnd - m_tokenBegin);
+}
+
+QByteArray QtXmlScanner::name()
+{
+    return m_name;
+}
+
+void QtXmlScanner::setUtf8Check(bool enable)
+{
+    m_utf8Check = enable;
+}
+
+QString QtXmlScanner::errorString()
+{
+    return m_errorString;
+}
+
+bool QtXmlScanner::fill()
+{
+    if(m_atEnd)
+    {
+        return false;
+    }
+
+    // Drop consumed bytes, keep the markup being scanned and an
+    // incomplete UTF-8 sequence waiting for the next chunk
+    int drop = m_utf8Check ? qMin(m_pos, m_utf8Pos) : m_pos;
+
+    if(drop > 0)
+    {
+        m_buffer.remove(0, drop);
+        m_bufferBase += drop;
+        m_pos -= drop;
+        m_utf8Pos -= drop;
+    }
+
+    QByteArray chunk = m_device->read(m_chunkSize);
+
+    if(chunk.isEmpty())
+    {
+        m_atEnd = true;
+
+        // Input ends inside a UTF-8 sequence
+        if(m_utf8Check && m_utf8Pos < m_buffer.size())
+        {
+            m_utf8Error = true;
+        }
+
+        return false;
+    }
+
+    m_buffer.append(chunk);
+
+    if(m_utf8Check && !m_utf8Error)
+    {
+        int valid = QtXmlSimd::validateUtf8(m_buffer.constData() + m_utf8Pos, m_buffer.size() - m_utf8Pos);
+
+        if(valid < 0)
+        {
+            m_utf8Error = true;
+        }
+        else
+        {
+            m_utf8Pos += valid;
+        }
+    }
+
+    return true;
+}
+
+int QtXmlScanner::findMarkupEnd(const char *terminator, int skip)
+{
+    int offset = skip;  // Search position relative to m_pos, survives fill()
+    char quote = 0;
+    int depth = 0;
+    int termLen = (NULL != terminator) ? (int)strlen(terminator) : 0;
+
+    for(;;)
+    {
+        const char *data = m_buffer.constData();
+        int size = m_buffer.size();
+
+        if(NULL != terminator)
+        {
+            // Find the first byte of the terminator in bulk, then compare the rest
+            int i = m_pos + offset;
+
+            while(i + termLen <= size)
+            {
+                int idx = QtXmlSimd::findByte(data + i, size - i - (termLen - 1), terminator[0]);
+
+                if(idx < 0)
+                {
+                    break;
+                }
+
+                i += idx;
+
+                if(0 == memcmp(data + i, terminator, termLen))
+                {
+                    return i + termLen;
+                }
+
+                i++;
+            }
+
+            // Terminator may be split by the chunk boundary
+            offset = qMax(skip, size - m_pos - (termLen - 1));
+        }
+        else
+        {
+            int i = m_pos + offset;
+
+            while(i < size)
+            {
+                // Jump to the next byte which can change the state
+                int idx = (0 != quote) ? QtXmlSimd::findByte(data + i, size - i, quote)
+                                       : QtXmlSimd::findFirstOf(data + i, size - i, ">\"'[]");
+
+                if(idx < 0)
+                {
+                    i = size;
+                    break;
+                }
+
+                i += idx;
+                char c = data[i];
+
+                if(0 != quote)
+                {
+                    quote = 0;
+                }
+                else if('"' == c || '\'' == c)
+                {
+                    quote = c;
+                }
+                else if('[' == c)
+                {
+                    depth++;
+                }
+                else if(']' == c)
+                {
+                    depth--;
+                }
+                else if(depth <= 0)
+                {
+                    return i + 1;
+                }
+
+                i++;
+            }
+
+            offset = size - m_pos;
+        }
+
+        if(!fill())
+        {
+            return -1;
+        }
+    }
+}
+
+QtXmlScanner::TokenType QtXmlScanner::setError(QString message)
+{
+    m_type = Error;
+    m_errorString = message;
+    m_tokenBegin = m_pos;
+    m_tokenEnd = m_pos;
+
+    return m_type;
+}
@@ -0,0 +1,159 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           QtXmlScanner.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Byte level XML markup scanner, reports every token with
+                its byte range in the input device. The device should be
+                opened without QIODevice::Text so offsets match the file.
+**********************************************************************/
+#ifndef QTXMLSCANNER_H
+#define QTXMLSCANNER_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QString>
+
+
+class QtXmlScanner
+{
+public:
+
+    enum TokenType
+    {
+        NoToken = 0,
+        StartElement,       // <name ...>
+        EmptyElement,       // <name .../>
+        EndElement,         // </name>
+        Text,               // Character data, may be split into several tokens
+        CData,              // <![CDATA[...]]>
+        Comment,            // <!--...-->
+        ProcessingInstruction, // <?...?>
+        Declaration,        // <!DOCTYPE ...>
+        EndOfFile,
+        Error
+    };
+
+    // chunkSize 0 means 1 MB
+    QtXmlScanner(QIODevice *device, int chunkSize = 0);
+    virtual ~QtXmlScanner();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		readNext
+    PURPOSE:		Read the next token
+    ARGUMENTS:		None
+    RETURNS:		TokenType, type of the token read
+    -----------------------------------------------------------------------*/
+    TokenType readNext();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		tokenType
+    PURPOSE:		Get the type of the current token
+    ARGUMENTS:		None
+    RETURNS:		TokenType
+    -----------------------------------------------------------------------*/
+    TokenType tokenType();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		tokenBegin
+    PURPOSE:		Get byte offset of the first byte of the current token
+    ARGUMENTS:		None
+    RETURNS:		qint64, offset from the beginning of the device
+    -----------------------------------------------------------------------*/
+    qint64 tokenBegin();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		tokenEnd
+    PURPOSE:		Get byte offset after the last byte of the current token
+    ARGUMENTS:		None
+    RETURNS:		qint64, offset from the beginning of the device
+    -----------------------------------------------------------------------*/
+    qint64 tokenEnd();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		tokenData
+    PURPOSE:		Get raw bytes of the current token, valid until next readNext()
+    ARGUMENTS:		None
+    RETURNS:		QByteArray
+    -----------------------------------------------------------------------*/
+    QByteArray tokenData();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		name
+    PURPOSE:		Get tag name of the current start, empty or end element
+    ARGUMENTS:		None
+    RETURNS:		QByteArray, empty for other tokens
+    -----------------------------------------------------------------------*/
+    QByteArray name();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setUtf8Check
+    PURPOSE:		Validate UTF-8 of the input while reading, invalid input is
+                    reported as Error. Call before the first readNext().
+    ARGUMENTS:		bool enable, true: validate, false: no check (default)
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setUtf8Check(bool enable);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		errorString
+    PURPOSE:		Get the error message after readNext() returned Error
+    ARGUMENTS:		None
+    RETURNS:		QString
+    -----------------------------------------------------------------------*/
+    QString errorString();
+
+private:
+    QIODevice *m_device;
+    int m_chunkSize;
+
+    QByteArray m_buffer;    // Bytes read from device and not consumed yet
+    qint64 m_bufferBase;    // Device offset of m_buffer[0]
+    int m_pos;              // Scan position in m_buffer
+    bool m_atEnd;           // Device has no more data
+
+    bool m_utf8Check;
+    int m_utf8Pos;          // Bytes of m_buffer validated as UTF-8
+    bool m_utf8Error;
+
+    TokenType m_type;
+    int m_tokenBegin;       // Current token range in m_buffer
+    int m_tokenEnd;
+    QByteArray m_name;
+    QString m_errorString;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		fill
+    PURPOSE:		Drop consumed bytes and append the next chunk from device
+    ARGUMENTS:		None
+    RETURNS:		bool, true: new data appended, false: end of device
+    -----------------------------------------------------------------------*/
+    bool fill();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		findMarkupEnd
+    PURPOSE:		Find the end of the markup starting at m_pos, reads more data if needed
+    ARGUMENTS:		const char *terminator, end string, NULL means '>' outside quotes and brackets
+                    int skip, number of bytes of the markup start to skip
+    RETURNS:		int, index in m_buffer after the terminator, -1 on end of device
+    -----------------------------------------------------------------------*/
+    int findMarkupEnd(const char *terminator, int skip);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setError
+    PURPOSE:		Set error state
+    ARGUMENTS:		QString message, error message
+    RETURNS:		TokenType, always Error
+    -----------------------------------------------------------------------*/
+    TokenType setError(QString message);
+};
+
+#endif // QTXMLSCANNER_H
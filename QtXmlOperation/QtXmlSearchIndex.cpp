@@ -0,0 +1,176 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           QtXmlSearchIndex.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Word index of an xml file for incremental search
+**********************************************************************/
+
+#include "QtXmlSearchIndex.h"
+#include <QFile>
+#include <QXmlStreamReader>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <iterator>
+
+QtXmlSearchIndex::QtXmlSearchIndex() :
+    m_elementCount(0)
+{
+    m_words.clear();
+}
+
+QtXmlSearchIndex::~QtXmlSearchIndex()
+{
+}
+
+QtXmlSearchIndex QtXmlSearchIndex::build(QString fileName)
+{
+    QtXmlSearchIndex index;
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        index.m_errorString = file.errorString();
+        return index;
+    }
+
+    QXmlStreamReader reader(&file);
+    reader.setNamespaceProcessing(false);
+
+    QVector<int> elementStack;  // Numbers of the open elements
+
+    while(!reader.atEnd())
+    {
+        QXmlStreamReader::TokenType token = reader.readNext();
+
+        if(QXmlStreamReader::StartElement == token)
+        {
+            int element = index.m_elementCount++;
+            elementStack.append(element);
+
+            index.addWords(reader.qualifiedName().toString(), element);
+
+            QXmlStreamAttributes attrs = reader.attributes();
+            for(int i = 0; i < attrs.size(); i++)
+            {
+                index.addWords(attrs.at(i).qualifiedName().toString(), element);
+                index.addWords(attrs.at(i).value().toString(), element);
+            }
+        }
+        else if(QXmlStreamReader::EndElement == token)
+        {
+            elementStack.removeLast();
+        }
+        else if(QXmlStreamReader::Characters == token && !reader.isWhitespace() && !elementStack.isEmpty())
+        {
+            index.addWords(reader.text().toString(), elementStack.last());
+        }
+    }
+
+    if(reader.hasError())
+    {
+        QtXmlSearchIndex failed;
+        failed.m_errorString = QString("Parse error at line %1, column %2: %3")
+                .arg(reader.lineNumber())
+                .arg(reader.columnNumber())
+                .arg(reader.errorString());
+
+        return failed;
+    }
+
+    index.m_sortedWords = index.m_words.keys();
+    qSort(index.m_sortedWords);
+
+    return index;
+}
+
+QVector<int> QtXmlSearchIndex::find(QString query) const
+{
+    QVector<int> ret;
+    QStringList words = splitWords(query);
+
+    for(int i = 0; i < words.size(); i++)
+    {
+        // Every indexed word starting with words[i] is adjacent in the sorted list
+        QVector<int> found;
+        QStringList::const_iterator it = qLowerBound(m_sortedWords.constBegin(), m_sortedWords.constEnd(), words.at(i));
+
+        for(; it != m_sortedWords.constEnd() && (*it).startsWith(words.at(i)); ++it)
+        {
+            found += m_words.value(*it);
+        }
+
+        qSort(found);
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+
+        if(0 == i)
+        {
+            ret = found;
+        }
+        else
+        {
+            // Keep elements containing all words
+            QVector<int> both;
+            std::set_intersection(ret.constBegin(), ret.constEnd(), found.constBegin(), found.constEnd(),
+                                  std::back_inserter(both));
+            ret = both;
+        }
+
+        if(ret.isEmpty())
+        {
+            break;
+        }
+    }
+
+    return ret;
+}
+
+int QtXmlSearchIndex::elementCount() const
+{
+    return m_elementCount;
+}
+
+QString QtXmlSearchIndex::errorString()
+{
+    return m_errorString;
+}
+
+void QtXmlSearchIndex::addWords(const QString &text, int element)
+{
+    QStringList words = splitWords(text);
+
+    for(int i = 0; i < words.size(); i++)
+    {
+        QVector<int> &elements = m_words[words.at(i)];
+
+        // Elements are indexed in ascending order, skip a repeated word
+        if(elements.isEmpty() || elements.last() != element)
+        {
+            elements.append(element);
+        }
+    }
+}
+
+QStringList QtXmlSearchIndex::splitWords(const QString &text)
+{
+    QStringList ret;
+    const QChar *data = text.constData();
+    int begin = -1;
+
+    for(int i = 0; i <= text.size(); i++)
+    {
+        bool wordChar = (i < text.size()) && (data[i].isLetterOrNumber() || '_' == data[i]);
+
+        if(wordChar && begin < 0)
+        {
+            begin = i;
+        }
+        else if(!wordChar && begin >= 0)
+        {
+            ret.append(text.mid(begin, i - begin).toLower());
+            begin = -1;
+        }
+    }
+
+    return ret;
+}
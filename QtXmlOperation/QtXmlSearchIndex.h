@@ -0,0 +1,89 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           QtXmlSearchIndex.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Word index of an xml file, tag names, attribute names,
+                attribute values and texts are split into lower case
+                words which map to the elements containing them.
+                Elements are numbered in document order (pre-order).
+**********************************************************************/
+#ifndef QTXMLSEARCHINDEX_H
+#define QTXMLSEARCHINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+
+
+class QtXmlSearchIndex
+{
+public:
+
+    QtXmlSearchIndex();
+    virtual ~QtXmlSearchIndex();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		build
+    PURPOSE:		Stream an xml file in disk and index it, no DOM is built,
+                    may run in a worker thread
+    ARGUMENTS:		QString fileName, file name
+    RETURNS:		QtXmlSearchIndex, empty index on failure
+    -----------------------------------------------------------------------*/
+    static QtXmlSearchIndex build(QString fileName);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		find
+    PURPOSE:		Find elements containing every word of query, words of the
+                    query match as prefixes and case insensitive
+    ARGUMENTS:		QString query, words separated by non-word characters
+    RETURNS:		QVector<int>, element numbers in document order
+    -----------------------------------------------------------------------*/
+    QVector<int> find(QString query) const;
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		elementCount
+    PURPOSE:		Get the number of indexed elements
+    ARGUMENTS:		None
+    RETURNS:		int, 0 for an empty index
+    -----------------------------------------------------------------------*/
+    int elementCount() const;
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		errorString
+    PURPOSE:		Get the reason of a failed build
+    ARGUMENTS:		None
+    RETURNS:		QString, empty after success
+    -----------------------------------------------------------------------*/
+    QString errorString();
+
+private:
+    int m_elementCount;
+    QHash<QString, QVector<int> > m_words;  // Word to element numbers, ascending
+    QStringList m_sortedWords;              // Keys of m_words, sorted for prefix lookup
+    QString m_errorString;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		addWords
+    PURPOSE:		Split text into lower case words and map them to element
+    ARGUMENTS:		const QString &text, text to split
+                    int element, element number
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void addWords(const QString &text, int element);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		splitWords
+    PURPOSE:		Split text at non-word characters, same as "\\W+"
+    ARGUMENTS:		const QString &text, text to split
+    RETURNS:		QStringList, lower case words
+    -----------------------------------------------------------------------*/
+    static QStringList splitWords(const QString &text);
+};
+
+#endif // QTXMLSEARCHINDEX_H
@@ -0,0 +1,471 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           QtXmlSimd.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Bulk byte scanning for the XML tokenizer
+**********************************************************************/
+
+#include "QtXmlSimd.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define XML_SIMD_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// AVX2 code is compiled for the target of its own functions only,
+// so the rest of the binary still runs on CPUs without AVX2
+#if defined(XML_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define XML_SIMD_AVX2 1
+#define XML_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(XML_SIMD_X86) && defined(_MSC_VER)
+#define XML_SIMD_AVX2 1
+#define XML_TARGET_AVX2
+#endif
+
+// SSE2 is part of x86-64, on 32 bit x86 it must be enabled by the compiler
+#if defined(XML_SIMD_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define XML_SIMD_SSE2 1
+#endif
+
+typedef int (*FindFirstOfFunction)(const char *data, int size, const char *set, int setSize);
+typedef int (*SkipWhitespaceFunction)(const char *data, int size);
+typedef int (*AsciiPrefixFunction)(const char *data, int size);
+
+struct XmlSimdFunctions
+{
+    QtXmlSimd::Level level;
+    FindFirstOfFunction findFirstOf;
+    SkipWhitespaceFunction skipWhitespace;
+    AsciiPrefixFunction asciiPrefix;
+};
+
+static inline int countTrailingZeros(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline bool isWhitespace(char c)
+{
+    return (' ' == c || '\t' == c || '\r' == c || '\n' == c);
+}
+
+//-----------------------------------------------------------------------
+// Scalar
+//-----------------------------------------------------------------------
+
+// memchr of the C library is vectorized already and is used on every level
+static int findByteScalar(const char *data, int size, char c)
+{
+    const void *p = memchr(data, c, size);
+
+    return (NULL != p) ? (int)((const char *)p - data) : -1;
+}
+
+static int findFirstOfScalar(const char *data, int size, const char *set, int setSize)
+{
+    for(int i = 0; i < size; i++)
+    {
+        for(int j = 0; j < setSize; j++)
+        {
+            if(data[i] == set[j])
+            {
+                return i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static int skipWhitespaceScalar(const char *data, int size)
+{
+    int i = 0;
+
+    while(i < size && isWhitespace(data[i]))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+static int asciiPrefixScalar(const char *data, int size)
+{
+    int i = 0;
+
+    // 8 bytes at a time
+    for(; i + 8 <= size; i += 8)
+    {
+        unsigned long long word;
+        memcpy(&word, data + i, 8);
+
+        if(0 != (word & 0x8080808080808080ULL))
+        {
+            break;
+        }
+    }
+
+    while(i < size && 0 == (data[i] & 0x80))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+//-----------------------------------------------------------------------
+// SSE2, 16 bytes per step
+//-----------------------------------------------------------------------
+
+#ifdef XML_SIMD_SSE2
+
+static int findFirstOfSse2(const char *data, int size, const char *set, int setSize)
+{
+    __m128i needles[8];
+    int i = 0;
+
+    for(int j = 0; j < setSize; j++)
+    {
+        needles[j] = _mm_set1_epi8(set[j]);
+    }
+
+    for(; i + 16 <= size; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i hits = _mm_cmpeq_epi8(chunk, needles[0]);
+
+        for(int j = 1; j < setSize; j++)
+        {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, needles[j]));
+        }
+
+        int mask = _mm_movemask_epi8(hits);
+
+        if(0 != mask)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+
+    int ret = findFirstOfScalar(data + i, size - i, set, setSize);
+
+    return (ret < 0) ? -1 : (i + ret);
+}
+
+static int skipWhitespaceSse2(const char *data, int size)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    int i = 0;
+
+    for(; i + 16 <= size; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, lf)));
+        int mask = ~_mm_movemask_epi8(ws) & 0xFFFF;
+
+        if(0 != mask)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+
+    return i + skipWhitespaceScalar(data + i, size - i);
+}
+
+static int asciiPrefixSse2(const char *data, int size)
+{
+    int i = 0;
+
+    for(; i + 16 <= size; i += 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(data + i)));
+
+        if(0 != mask)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+
+    return i + asciiPrefixScalar(data + i, size - i);
+}
+
+#endif // XML_SIMD_SSE2
+
+//-----------------------------------------------------------------------
+// AVX2, 32 bytes per step
+//-----------------------------------------------------------------------
+
+#ifdef XML_SIMD_AVX2
+
+XML_TARGET_AVX2 static int findFirstOfAvx2(const char *data, int size, const char *set, int setSize)
+{
+    __m256i needles[8];
+    int i = 0;
+
+    for(int j = 0; j < setSize; j++)
+    {
+        needles[j] = _mm256_set1_epi8(set[j]);
+    }
+
+    for(; i + 32 <= size; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i hits = _mm256_cmpeq_epi8(chunk, needles[0]);
+
+        for(int j = 1; j < setSize; j++)
+        {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, needles[j]));
+        }
+
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+
+        if(0 != mask)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+
+    int ret = findFirstOfScalar(data + i, size - i, set, setSize);
+
+    return (ret < 0) ? -1 : (i + ret);
+}
+
+XML_TARGET_AVX2 static int skipWhitespaceAvx2(const char *data, int size)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    int i = 0;
+
+    for(; i + 32 <= size; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr), _mm256_cmpeq_epi8(chunk, lf)));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(ws);
+
+        if(0 != mask)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+
+    return i + skipWhitespaceScalar(data + i, size - i);
+}
+
+XML_TARGET_AVX2 static int asciiPrefixAvx2(const char *data, int size)
+{
+    int i = 0;
+
+    for(; i + 32 <= size; i += 32)
+    {
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(data + i)));
+
+        if(0 != mask)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+
+    return i + asciiPrefixScalar(data + i, size - i);
+}
+
+static bool cpuHasAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+
+    // OS must save the AVX registers (OSXSAVE and XCR0 bits 1, 2)
+    __cpuid(info, 1);
+    if(0 == (info[2] & (1 << 27)) || 0x6 != (_xgetbv(0) & 0x6))
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (0 != (info[1] & (1 << 5)));
+#else
+    __builtin_cpu_init();
+    return (0 != __builtin_cpu_supports("avx2"));
+#endif
+}
+
+#endif // XML_SIMD_AVX2
+
+//-----------------------------------------------------------------------
+// Runtime selection
+//-----------------------------------------------------------------------
+
+static XmlSimdFunctions selectFunctions(QtXmlSimd::Level wanted)
+{
+    XmlSimdFunctions functions;
+    functions.level = QtXmlSimd::LevelScalar;
+    functions.findFirstOf = findFirstOfScalar;
+    functions.skipWhitespace = skipWhitespaceScalar;
+    functions.asciiPrefix = asciiPrefixScalar;
+
+#ifdef XML_SIMD_SSE2
+    if(wanted >= QtXmlSimd::LevelSse2)
+    {
+        functions.level = QtXmlSimd::LevelSse2;
+        functions.findFirstOf = findFirstOfSse2;
+        functions.skipWhitespace = skipWhitespaceSse2;
+        functions.asciiPrefix = asciiPrefixSse2;
+    }
+#endif
+
+#ifdef XML_SIMD_AVX2
+    if(wanted >= QtXmlSimd::LevelAvx2 && cpuHasAvx2())
+    {
+        functions.level = QtXmlSimd::LevelAvx2;
+        functions.findFirstOf = findFirstOfAvx2;
+        functions.skipWhitespace = skipWhitespaceAvx2;
+        functions.asciiPrefix = asciiPrefixAvx2;
+    }
+#endif
+
+    return functions;
+}
+
+static XmlSimdFunctions &simdFunctions()
+{
+    static XmlSimdFunctions functions = selectFunctions(QtXmlSimd::LevelAvx2);
+
+    return functions;
+}
+
+int QtXmlSimd::findByte(const char *data, int size, char c)
+{
+    return (size > 0) ? findByteScalar(data, size, c) : -1;
+}
+
+int QtXmlSimd::findFirstOf(const char *data, int size, const char *set)
+{
+    int setSize = (int)strlen(set);
+
+    if(setSize > 8)
+    {
+        setSize = 8;
+    }
+
+    return (size > 0 && setSize > 0) ? simdFunctions().findFirstOf(data, size, set, setSize) : -1;
+}
+
+int QtXmlSimd::skipWhitespace(const char *data, int size)
+{
+    return (size > 0) ? simdFunctions().skipWhitespace(data, size) : 0;
+}
+
+int QtXmlSimd::validateUtf8(const char *data, int size)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    AsciiPrefixFunction asciiPrefix = simdFunctions().asciiPrefix;
+    int i = 0;
+
+    while(i < size)
+    {
+        // Skip ASCII runs in wide chunks
+        i += asciiPrefix(data + i, size - i);
+
+        if(i >= size)
+        {
+            break;
+        }
+
+        unsigned char c = p[i];
+        int length = 0;
+
+        if(c >= 0xC2 && c <= 0xDF)
+        {
+            length = 2;
+        }
+        else if(c >= 0xE0 && c <= 0xEF)
+        {
+            length = 3;
+        }
+        else if(c >= 0xF0 && c <= 0xF4)
+        {
+            length = 4;
+        }
+        else
+        {
+            // Continuation byte without lead, overlong lead or out of range
+            return -1;
+        }
+
+        int available = (size - i < length) ? (size - i) : length;
+
+        for(int j = 1; j < available; j++)
+        {
+            if(0x80 != (p[i + j] & 0xC0))
+            {
+                return -1;
+            }
+        }
+
+        // Overlong forms, surrogates and code points above U+10FFFF
+        if(available > 1)
+        {
+            unsigned char next = p[i + 1];
+
+            if((0xE0 == c && next < 0xA0) || (0xED == c && next >= 0xA0)
+                    || (0xF0 == c && next < 0x90) || (0xF4 == c && next >= 0x90))
+            {
+                return -1;
+            }
+        }
+
+        // Incomplete sequence at the end, may continue in the next chunk
+        if(available < length)
+        {
+            return i;
+        }
+
+        i += length;
+    }
+
+    return i;
+}
+
+QtXmlSimd::Level QtXmlSimd::level()
+{
+    return simdFunctions().level;
+}
+
+QtXmlSimd::Level QtXmlSimd::setLevel(Level level)
+{
+    simdFunctions() = selectFunctions(level);
+
+    return simdFunctions().level;
+}
+
+const char *QtXmlSimd::levelName()
+{
+    switch(level())
+    {
+    case LevelAvx2:
+        return "avx2";
+    case LevelSse2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
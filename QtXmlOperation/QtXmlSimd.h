@@ -0,0 +1,96 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           QtXmlSimd.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Bulk byte scanning for the XML tokenizer, uses AVX2 or
+                SSE2 when the CPU supports it, scalar code otherwise.
+                The level is selected once at runtime.
+**********************************************************************/
+#ifndef QTXMLSIMD_H
+#define QTXMLSIMD_H
+
+
+class QtXmlSimd
+{
+public:
+
+    enum Level
+    {
+        LevelScalar = 0,
+        LevelSse2,
+        LevelAvx2
+    };
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		findByte
+    PURPOSE:		Find the first occurrence of c
+    ARGUMENTS:		const char *data, bytes to scan
+                    int size, number of bytes
+                    char c, byte to find
+    RETURNS:		int, index of c, -1: not found
+    -----------------------------------------------------------------------*/
+    static int findByte(const char *data, int size, char c);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		findFirstOf
+    PURPOSE:		Find the first byte which is one of set
+    ARGUMENTS:		const char *data, bytes to scan
+                    int size, number of bytes
+                    const char *set, bytes to find, zero terminated, at most 8
+    RETURNS:		int, index of the byte, -1: not found
+    -----------------------------------------------------------------------*/
+    static int findFirstOf(const char *data, int size, const char *set);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		skipWhitespace
+    PURPOSE:		Find the first byte which is not XML whitespace (space, \t, \r, \n)
+    ARGUMENTS:		const char *data, bytes to scan
+                    int size, number of bytes
+    RETURNS:		int, index of the byte, size: all whitespace
+    -----------------------------------------------------------------------*/
+    static int skipWhitespace(const char *data, int size);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		validateUtf8
+    PURPOSE:		Validate UTF-8, ASCII runs are skipped in wide chunks
+    ARGUMENTS:		const char *data, bytes to check
+                    int size, number of bytes
+    RETURNS:		int, number of valid bytes, less than size when data ends
+                    with an incomplete sequence, -1: invalid
+    -----------------------------------------------------------------------*/
+    static int validateUtf8(const char *data, int size);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		level
+    PURPOSE:		Get the level in use
+    ARGUMENTS:		None
+    RETURNS:		Level
+    -----------------------------------------------------------------------*/
+    static Level level();
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setLevel
+    PURPOSE:		Force a lower level, for comparison only, not thread safe
+    ARGUMENTS:		Level level, wanted level, limited to what the CPU supports
+    RETURNS:		Level, level in use
+    -----------------------------------------------------------------------*/
+    static Level setLevel(Level level);
+
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		levelName
+    PURPOSE:		Get the name of the level in use
+    ARGUMENTS:		None
+    RETURNS:		const char *, "scalar", "sse2" or "avx2"
+    -----------------------------------------------------------------------*/
+    static const char *levelName();
+};
+
+#endif // QTXMLSIMD_H
@@ -0,0 +1,531 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           QtXmlTool.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Headless command line tool, runs query, count, extract,
+                convert, validate and split on many xml files in parallel
+**********************************************************************/
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+#include <QTextStream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "QtXmlOperation.h"
+
+enum Command
+{
+    CommandNone = 0,
+    CommandQuery,       // Print text or attribute of matching nodes
+    CommandCount,       // Print number of matching nodes
+    CommandExtract,     // Export records to CSV or JSON lines
+    CommandConvert,     // Rewrite as indented UTF-8
+    CommandValidate,    // Check well-formedness without DOM
+    CommandSplit        // Split into shards with the same root
+};
+
+// Parsed command line, read only once the files are processed
+struct Options
+{
+    Command command;
+    QString path;                       // query, count: node names, extract: record path
+    QString attribute;                  // query: print this attribute instead of the text
+    QStringList columns;                // extract: column mapping
+    QtXmlOperation::ExportFormat format;
+    QString outputDir;                  // extract, convert
+    QStringList requiredPaths;          // validate
+    int maxElements;                    // validate
+    int recordsPerShard;                // split
+    qint64 bytesPerShard;               // split
+    QtXmlOperation::ParserType parserType;
+    qint64 memoryLimit;
+};
+
+// Input file and its name relative to the given directory, used for output names
+struct InputFile
+{
+    QString fileName;
+    QString relativeName;
+};
+
+struct FileResult
+{
+    QString fileName;
+    bool ok;
+    QStringList lines;      // Printed to stdout
+    QString summary;        // Printed to stderr next to the timing
+    qint64 elapsed;         // Milliseconds
+};
+
+// Processes one file, run by QtConcurrent::mapped
+class FileTask
+{
+public:
+    typedef FileResult result_type;
+
+    FileTask(const Options &options) :
+        m_options(options)
+    {
+    }
+
+    FileResult operator()(const InputFile &input);
+
+private:
+    Options m_options;
+
+    QString outputName(const InputFile &input, QString suffix);
+};
+
+static bool g_verbose = false;
+
+static void messageHandler(QtMsgType type, const char *msg)
+{
+    // QtXmlOperation reports parse errors by qDebug, the tool prints its own
+    if(QtDebugMsg == type && !g_verbose)
+    {
+        return;
+    }
+
+    fprintf(stderr, "%s\n", msg);
+
+    if(QtFatalMsg == type)
+    {
+        abort();
+    }
+}
+
+static void printUsage()
+{
+    QTextStream err(stderr);
+
+    err << "Usage: QtXmlTool <command> [options] <file|dir>...\n"
+        << "\n"
+        << "Commands:\n"
+        << "  query <path>              Print the text of every node matching path\n"
+        << "  count <path>              Print the number of nodes matching path\n"
+        << "  extract <path> <columns>  Export records at path to CSV or JSON lines, columns\n"
+        << "                            separated by ',' (\"@Value\", \"Name\", \"Name/@Unit\", \".\")\n"
+        << "  convert                   Rewrite documents as indented UTF-8 into the output dir\n"
+        << "  validate                  Check well-formedness without building a DOM\n"
+        << "  split <record>            Split into shards with the same root, record is the tag\n"
+        << "                            of the repeated root children, \"*\" for all children\n"
+        << "\n"
+        << "Options:\n"
+        << "  -a, --attribute <name>    query: print attribute name instead of the text\n"
+        << "  -f, --format <csv|jsonl>  extract: output format, default csv\n"
+        << "  -o, --output <dir>        extract, split: output dir, default next to the input\n"
+        << "                            convert: output dir, required\n"
+        << "  -r, --require <path>      validate: path that must exist, may be repeated\n"
+        << "  -m, --max-elements <n>    validate: fail above n elements\n"
+        << "      --records <n>         split: records per shard\n"
+        << "      --bytes <n>           split: bytes per shard\n"
+        << "  -j, --jobs <n>            files processed in parallel, default CPU cores\n"
+        << "      --fast                use the fast parser (ParserFast)\n"
+        << "      --memory-limit <n>    fail documents above n bytes estimated memory\n"
+        << "  -v, --verbose             print parser messages\n"
+        << "  -h, --help                print this help\n"
+        << "\n"
+        << "Directories are searched recursively for *.xml. Per file timing goes to stderr.\n";
+}
+
+QString FileTask::outputName(const InputFile &input, QString suffix)
+{
+    QString name = input.relativeName;
+
+    if(!suffix.isEmpty())
+    {
+        QFileInfo info(name);
+        name = info.path() + "/" + info.completeBaseName() + suffix;
+    }
+
+    if(m_options.outputDir.isEmpty())
+    {
+        return QFileInfo(input.fileName).absolutePath() + "/" + QFileInfo(name).fileName();
+    }
+
+    QString ret = QDir::cleanPath(m_options.outputDir + "/" + name);
+    QDir().mkpath(QFileInfo(ret).absolutePath());
+
+    return ret;
+}
+
+FileResult FileTask::operator()(const InputFile &input)
+{
+    FileResult result;
+    result.fileName = input.fileName;
+    result.ok = false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if(CommandQuery == m_options.command || CommandCount == m_options.command || CommandConvert == m_options.command)
+    {
+        QtXmlOperation xml;
+        xml.setParserType(m_options.parserType);
+        xml.setMemoryLimit(m_options.memoryLimit);
+
+        if(!xml.openDocument(input.fileName))
+        {
+            result.summary = "can not be parsed";
+        }
+        else if(CommandQuery == m_options.command)
+        {
+            // One traversal collecting every match, getNodeCount/readText only
+            // see the first matching child under each parent
+            result.lines = xml.readAll(m_options.path, m_options.attribute);
+            result.summary = QString("%1 nodes").arg(result.lines.size());
+            result.ok = true;
+        }
+        else if(CommandCount == m_options.command)
+        {
+            result.lines.append(QString::number(xml.countAll(m_options.path)));
+            result.ok = true;
+        }
+        else
+        {
+            QString output = outputName(input, "");
+
+            if(QFileInfo(output).absoluteFilePath() == QFileInfo(input.fileName).absoluteFilePath())
+            {
+                result.summary = "output would overwrite the input";
+            }
+            else if(xml.saveAs(output))
+            {
+                result.summary = QString("-> %1").arg(output);
+                result.ok = true;
+            }
+            else
+            {
+                result.summary = QString("%1 can not be written").arg(output);
+            }
+        }
+    }
+    else if(CommandExtract == m_options.command)
+    {
+        QString output = outputName(input, (QtXmlOperation::ExportCsv == m_options.format) ? ".csv" : ".jsonl");
+        QString errorStr = "";
+
+        qint64 records = QtXmlOperation::exportRecords(input.fileName, m_options.path, m_options.columns,
+                                                       output, m_options.format, &errorStr);
+
+        if(records >= 0)
+        {
+            result.summary = QString("%1 records -> %2").arg(records).arg(output);
+            result.ok = true;
+        }
+        else
+        {
+            result.summary = errorStr;
+        }
+    }
+    else if(CommandSplit == m_options.command)
+    {
+        QString errorStr = "";
+        QString recordName = ("*" == m_options.path) ? QString() : m_options.path;
+
+        int shards = QtXmlOperation::splitDocument(input.fileName, recordName, outputName(input, ""),
+                                                   m_options.recordsPerShard, m_options.bytesPerShard, &errorStr);
+
+        if(shards >= 0)
+        {
+            result.summary = QString("%1 shards").arg(shards);
+            result.ok = true;
+        }
+        else
+        {
+            result.summary = errorStr;
+        }
+    }
+    else if(CommandValidate == m_options.command)
+    {
+        QString errorStr = "";
+        int errorLine = 0;
+        int errorColumn = 0;
+
+        if(QtXmlOperation::validateDocument(input.fileName, m_options.requiredPaths, m_options.maxElements,
+                                            &errorStr, &errorLine, &errorColumn))
+        {
+            result.ok = true;
+        }
+        else if(errorLine > 0)
+        {
+            result.summary = QString("line %1, column %2: %3").arg(errorLine).arg(errorColumn).arg(errorStr);
+        }
+        else
+        {
+            result.summary = errorStr;
+        }
+    }
+
+    result.elapsed = timer.elapsed();
+
+    return result;
+}
+
+/*-----------------------------------------------------------------------
+FUNCTION:		collectFiles
+PURPOSE:		Expand files and directories (recursively, *.xml) to input files
+ARGUMENTS:		QStringList paths, command line paths
+                QList<InputFile> *files, output files in a stable order
+RETURNS:		bool, true: successful, false: a path does not exist
+-----------------------------------------------------------------------*/
+static bool collectFiles(QStringList paths, QList<InputFile> *files)
+{
+    for(int i = 0; i < paths.size(); i++)
+    {
+        QFileInfo info(paths.at(i));
+
+        if(info.isDir())
+        {
+            QDir dir(paths.at(i));
+            QStringList found;
+
+            QDirIterator it(paths.at(i), QStringList() << "*.xml", QDir::Files, QDirIterator::Subdirectories);
+            while(it.hasNext())
+            {
+                found.append(it.next());
+            }
+
+            found.sort();
+
+            for(int j = 0; j < found.size(); j++)
+            {
+                InputFile file;
+                file.fileName = found.at(j);
+                file.relativeName = dir.relativeFilePath(found.at(j));
+                files->append(file);
+            }
+        }
+        else if(info.isFile())
+        {
+            InputFile file;
+            file.fileName = paths.at(i);
+            file.relativeName = info.fileName();
+            files->append(file);
+        }
+        else
+        {
+            QTextStream(stderr) << paths.at(i) << ": no such file or directory\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    qInstallMsgHandler(messageHandler);
+
+    QStringList args = app.arguments();
+    args.removeFirst();
+
+    Options options;
+    options.command = CommandNone;
+    options.format = QtXmlOperation::ExportCsv;
+    options.maxElements = 0;
+    options.recordsPerShard = 0;
+    options.bytesPerShard = 0;
+    options.parserType = QtXmlOperation::ParserQDom;
+    options.memoryLimit = 0;
+
+    QStringList positional;
+    int jobs = 0;
+    bool ok = true;
+
+    for(int i = 0; i < args.size() && ok; i++)
+    {
+        QString arg = args.at(i);
+        bool hasValue = (i + 1 < args.size());
+
+        if("-h" == arg || "--help" == arg)
+        {
+            printUsage();
+            return 0;
+        }
+        else if("-v" == arg || "--verbose" == arg)
+        {
+            g_verbose = true;
+        }
+        else if("--fast" == arg)
+        {
+            options.parserType = QtXmlOperation::ParserFast;
+        }
+        else if(("-a" == arg || "--attribute" == arg) && hasValue)
+        {
+            options.attribute = args.at(++i);
+        }
+        else if(("-f" == arg || "--format" == arg) && hasValue)
+        {
+            QString format = args.at(++i).toLower();
+
+            if("csv" == format)
+            {
+                options.format = QtXmlOperation::ExportCsv;
+            }
+            else if("jsonl" == format)
+            {
+                options.format = QtXmlOperation::ExportJsonLines;
+            }
+            else
+            {
+                ok = false;
+            }
+        }
+        else if(("-o" == arg || "--output" == arg) && hasValue)
+        {
+            options.outputDir = args.at(++i);
+        }
+        else if(("-r" == arg || "--require" == arg) && hasValue)
+        {
+            options.requiredPaths.append(args.at(++i));
+        }
+        else if(("-m" == arg || "--max-elements" == arg) && hasValue)
+        {
+            options.maxElements = args.at(++i).toInt(&ok);
+        }
+        else if(("-j" == arg || "--jobs" == arg) && hasValue)
+        {
+            jobs = args.at(++i).toInt(&ok);
+            ok = ok && (jobs > 0);
+        }
+        else if("--records" == arg && hasValue)
+        {
+            options.recordsPerShard = args.at(++i).toInt(&ok);
+        }
+        else if("--bytes" == arg && hasValue)
+        {
+            options.bytesPerShard = args.at(++i).toLongLong(&ok);
+        }
+        else if("--memory-limit" == arg && hasValue)
+        {
+            options.memoryLimit = args.at(++i).toLongLong(&ok);
+        }
+        else if(arg.startsWith("-") && "-" != arg)
+        {
+            ok = false;
+        }
+        else
+        {
+            positional.append(arg);
+        }
+    }
+
+    // Command and its own arguments come first
+    int pathsBegin = 1;
+
+    if(ok && !positional.isEmpty())
+    {
+        QString command = positional.first();
+
+        if("query" == command || "count" == command)
+        {
+            options.command = ("query" == command) ? CommandQuery : CommandCount;
+            pathsBegin = 2;
+        }
+        else if("extract" == command)
+        {
+            options.command = CommandExtract;
+            pathsBegin = 3;
+        }
+        else if("convert" == command)
+        {
+            options.command = CommandConvert;
+            ok = !options.outputDir.isEmpty();
+        }
+        else if("validate" == command)
+        {
+            options.command = CommandValidate;
+        }
+        else if("split" == command)
+        {
+            options.command = CommandSplit;
+            pathsBegin = 2;
+            ok = (options.recordsPerShard > 0 || options.bytesPerShard > 0);
+        }
+
+        if(pathsBegin > 1 && positional.size() > 1)
+        {
+            options.path = positional.at(1);
+        }
+
+        if(CommandExtract == options.command && positional.size() > 2)
+        {
+            options.columns = positional.at(2).split(',', QString::SkipEmptyParts);
+        }
+    }
+
+    if(!ok || CommandNone == options.command || positional.size() <= pathsBegin)
+    {
+        printUsage();
+        return 2;
+    }
+
+    QList<InputFile> files;
+
+    if(!collectFiles(positional.mid(pathsBegin), &files))
+    {
+        return 2;
+    }
+
+    if(jobs > 0)
+    {
+        QThreadPool::globalInstance()->setMaxThreadCount(jobs);
+    }
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    out.setCodec("UTF-8");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Results are taken in input order while later files are still being processed
+    QFuture<FileResult> future = QtConcurrent::mapped(files, FileTask(options));
+    bool prefix = (files.size() > 1);
+    int failed = 0;
+
+    for(int i = 0; i < files.size(); i++)
+    {
+        FileResult result = future.resultAt(i);
+
+        for(int j = 0; j < result.lines.size(); j++)
+        {
+            if(prefix)
+            {
+                out << result.fileName << "\t";
+            }
+
+            out << result.lines.at(j) << "\n";
+        }
+        out.flush();
+
+        if(!result.ok)
+        {
+            failed++;
+        }
+
+        err << result.fileName << ": " << (result.ok ? "OK" : "FAILED") << " " << result.elapsed << " ms";
+
+        if(!result.summary.isEmpty())
+        {
+            err << ", " << result.summary;
+        }
+
+        err << "\n";
+        err.flush();
+    }
+
+    err << files.size() << " files, " << failed << " failed, " << timer.elapsed() << " ms, "
+        << QThreadPool::globalInstance()->maxThreadCount() << " jobs\n";
+
+    return (0 == failed) ? 0 : 1;
+}
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Headless command line tool, no GUI libraries
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = QtXmlTool
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(QtXmlCore.pri)
+
+
+SOURCES += QtXmlTool.cpp